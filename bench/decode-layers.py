@@ -0,0 +1,62 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+"""
+Benchmark for decoding with a limited number of quality layers.
+
+The images in examples/ are compressed with several quality layers (the
+last one lossless), and then decoded with 1, 2, ... of them.  For every
+layer count, the decode time, the speed-up over decoding all the layers
+and the mean absolute error are printed.
+"""
+
+from pathlib import Path
+from time import time
+
+import blosc2
+import blosc2_grok
+import numpy as np
+from PIL import Image
+
+
+RATES = [80, 40, 20, 10, 5, 1]
+NREPS = 5
+
+
+def decode_time(array, layers):
+    blosc2_grok.set_decode_layers(array, layers)
+    best = float('inf')
+    for _ in range(NREPS):
+        t0 = time()
+        out = array[...]
+        best = min(best, time() - t0)
+    blosc2_grok.set_decode_layers(array, None)
+    return best, out
+
+
+if __name__ == '__main__':
+    project_dir = Path(__file__).parent.parent
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+        'nthreads': 1,
+    }
+    dparams = {'nthreads': 1}
+    blosc2_grok.set_params_defaults(quality_mode='rates', quality_layers=np.array(RATES, dtype=np.float64))
+
+    for path in [project_dir / 'examples/kodim23.png', project_dir / 'examples/MI04_020751.tif']:
+        im = np.asarray(Image.open(path))
+        array = blosc2.asarray(im, chunks=im.shape, blocks=im.shape, cparams=cparams, dparams=dparams)
+        print(f"*** {path.name} {im.shape} {im.dtype}, cratio: {array.schunk.cratio:.1f}x")
+        tall, _ = decode_time(array, None)
+        for layers in range(1, len(RATES) + 1):
+            t, out = decode_time(array, layers)
+            err = np.abs(out.astype(np.float64) - im.astype(np.float64)).mean()
+            print(f"layers={layers} (rate {RATES[layers - 1]:2d}): {1000 * t:7.1f} ms, "
+                  f"speed-up {tall / t:4.2f}x, mean abs error {err:.3f}")
@@ -0,0 +1,64 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+"""
+Benchmark for coding samples with their actual bit depth.
+
+12-bit (and 10 and 14-bit) images stored as uint16 are built from the
+examples/ images, and compressed losslessly with the precision fixed to 16
+bits (what the encoder did before) and with the detected one.  The
+compression and decompression speeds (MB/s) and the ratio are printed for
+both.
+"""
+
+from pathlib import Path
+from time import time
+
+import blosc2
+import blosc2_grok
+import numpy as np
+from PIL import Image
+
+
+NREPS = 3
+
+
+def bench(array, **kwargs):
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    blosc2_grok.set_params_defaults(**kwargs)
+    ctime = float('inf')
+    for _ in range(NREPS):
+        t0 = time()
+        b2 = blosc2.asarray(array, chunks=array.shape, blocks=array.shape, cparams=cparams)
+        ctime = min(ctime, time() - t0)
+    blosc2_grok.set_params_defaults()
+    dtime = float('inf')
+    for _ in range(NREPS):
+        t0 = time()
+        out = b2[...]
+        dtime = min(dtime, time() - t0)
+    np.testing.assert_array_equal(out, array)
+    mb = array.nbytes / 2**20
+    return mb / ctime, mb / dtime, b2.schunk.cratio
+
+
+if __name__ == '__main__':
+    project_dir = Path(__file__).parent.parent
+    for path in [project_dir / 'examples/kodim23.png', project_dir / 'examples/MI04_020751.tif']:
+        im = np.asarray(Image.open(path).convert('L')).astype(np.uint16)
+        for bits in [10, 12, 14]:
+            array = im << (bits - 8)
+            print(f"*** {path.name} {array.shape}, {bits}-bit samples in uint16")
+            for name, kwargs in [('prec=16', {'bit_depth': 16}), ('detected', {})]:
+                cspeed, dspeed, cratio = bench(array, **kwargs)
+                print(f"{name:>10}: compress {cspeed:7.1f} MB/s, decompress {dspeed:7.1f} MB/s, "
+                      f"cratio {cratio:5.2f}x")
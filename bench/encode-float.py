@@ -0,0 +1,89 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+"""
+Benchmark for the error-bounded float32 mode.
+
+Synthetic smooth fields (a sum of sines plus a little noise, as in simulation
+outputs) are compressed with several absolute error bounds, and the ratio,
+the maximum error and the compression and decompression speeds (MB/s) are
+printed.  If `zfpy` is installed, zfp in fixed-accuracy mode with the same
+tolerances is run on the same data for comparison.
+"""
+
+from time import time
+
+import blosc2
+import blosc2_grok
+import numpy as np
+
+try:
+    import zfpy
+except ImportError:
+    zfpy = None
+
+
+NREPS = 3
+SHAPE = (2048, 2048)
+BLOCKS = (512, 512)
+
+
+def smooth_field(shape, seed=0):
+    rng = np.random.default_rng(seed)
+    y, x = np.meshgrid(np.linspace(0, 1, shape[0]), np.linspace(0, 1, shape[1]), indexing='ij')
+    field = np.zeros(shape)
+    for k in range(1, 6):
+        fx, fy, phase = rng.uniform(1, 4 * k, 3)
+        field += np.sin(2 * np.pi * (fx * x + fy * y) + phase) / k
+    field += rng.normal(scale=1e-3, size=shape)
+    return (100 * field).astype(np.float32)
+
+
+def bench_grok(array, error):
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    blosc2_grok.set_params_defaults(float_error=error)
+    ctime = float('inf')
+    for _ in range(NREPS):
+        t0 = time()
+        b2 = blosc2.asarray(array, chunks=array.shape, blocks=BLOCKS, cparams=cparams)
+        ctime = min(ctime, time() - t0)
+    blosc2_grok.set_params_defaults()
+    dtime = float('inf')
+    for _ in range(NREPS):
+        t0 = time()
+        out = b2[...]
+        dtime = min(dtime, time() - t0)
+    return ctime, dtime, b2.schunk.cratio, np.abs(out.astype(np.float64) - array).max()
+
+
+def bench_zfp(array, error):
+    ctime = dtime = float('inf')
+    for _ in range(NREPS):
+        t0 = time()
+        c = zfpy.compress_numpy(array, tolerance=error)
+        ctime = min(ctime, time() - t0)
+        t0 = time()
+        out = zfpy.decompress_numpy(c)
+        dtime = min(dtime, time() - t0)
+    return ctime, dtime, array.nbytes / len(c), np.abs(out.astype(np.float64) - array).max()
+
+
+if __name__ == '__main__':
+    array = smooth_field(SHAPE)
+    mb = array.nbytes / 2**20
+    print(f"*** smooth float32 field {array.shape}, values in [{array.min():.1f}, {array.max():.1f}]")
+    for error in [1e-1, 1e-2, 1e-3]:
+        codecs = [('grok', bench_grok)] + ([('zfp', bench_zfp)] if zfpy is not None else [])
+        for name, func in codecs:
+            ctime, dtime, cratio, maxerr = func(array, error)
+            print(f"error {error:g} {name:>5}: compress {mb / ctime:7.1f} MB/s, decompress {mb / dtime:7.1f} MB/s, "
+                  f"cratio {cratio:6.2f}x, max error {maxerr:.2e}")
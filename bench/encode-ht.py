@@ -0,0 +1,72 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+"""
+Benchmark for rates in high throughput mode.
+
+A stack of noisy, slowly changing frames is compressed in the rates quality
+mode with the classic (EBCOT) block coder and with the HT one, a frame per
+block.  The compression and decompression speeds are printed, together with
+the ratio achieved and the PSNR of the decoded stack.
+"""
+
+from time import time
+
+import blosc2
+import blosc2_grok
+import numpy as np
+from PIL import Image
+from pathlib import Path
+
+
+NFRAMES = 32
+NREPS = 3
+project_dir = Path(__file__).parent.parent
+
+
+def frames(nframes, seed=0):
+    rng = np.random.default_rng(seed)
+    im = np.asarray(Image.open(project_dir / 'examples/kodim23.png').convert('L')).astype(np.float64)
+    stack = [np.roll(im, k, axis=1) + rng.normal(scale=2, size=im.shape) for k in range(nframes)]
+    return np.clip(np.round(stack), 0, 255).astype(np.uint8)
+
+
+def psnr(a, b, peak=255):
+    mse = np.mean((a.astype(np.float64) - b) ** 2)
+    return np.inf if mse == 0 else 10 * np.log10(peak ** 2 / mse)
+
+
+def bench(array, rate, mode):
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    blosc2_grok.set_params_defaults(quality_mode='rates', quality_layers=np.array([rate], dtype=np.float64),
+                                    mode=mode)
+    ctime = dtime = np.inf
+    for _ in range(NREPS):
+        t0 = time()
+        b2 = blosc2.asarray(array, chunks=(8,) + array.shape[1:], blocks=(1,) + array.shape[1:], cparams=cparams)
+        ctime = min(ctime, time() - t0)
+        t0 = time()
+        out = b2[...]
+        dtime = min(dtime, time() - t0)
+    blosc2_grok.set_params_defaults()
+    return ctime, dtime, b2.schunk.cratio, psnr(out, array)
+
+
+if __name__ == '__main__':
+    array = frames(NFRAMES)
+    mb = array.nbytes / 2**20
+    print(f"*** stack of {array.shape} frames")
+    for rate in [4, 10, 20]:
+        for mode in [blosc2_grok.GrkMode.DEFAULT, blosc2_grok.GrkMode.HT]:
+            ctime, dtime, cratio, quality = bench(array, rate, mode)
+            print(f"rate {rate:3d}, {mode.name:7}: compress {mb / ctime:6.1f} MB/s, decompress {mb / dtime:6.1f} MB/s, "
+                  f"cratio {cratio:6.2f}x, PSNR {quality:5.2f} dB")
@@ -0,0 +1,73 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+"""
+Benchmark for coding to a target quality.
+
+A stack of noisy, slowly changing frames is compressed with several target
+SSIM values, a frame per block.  The compression time and ratio are printed,
+together with the quality achieved and the encode and decode passes spent
+per block (the first block of every thread searches from scratch, and the
+next ones start from the rate of the previous one).  If scikit-image is
+installed, the SSIM of every decoded frame is checked with it too (it uses
+a sliding window, so it differs slightly from the one of the plugin).
+"""
+
+from time import time
+
+import blosc2
+import blosc2_grok
+import numpy as np
+from PIL import Image
+from pathlib import Path
+
+try:
+    from skimage.metrics import structural_similarity
+except ImportError:
+    structural_similarity = None
+
+
+NFRAMES = 32
+project_dir = Path(__file__).parent.parent
+
+
+def frames(nframes, seed=0):
+    rng = np.random.default_rng(seed)
+    im = np.asarray(Image.open(project_dir / 'examples/kodim23.png').convert('L')).astype(np.float64)
+    stack = [np.roll(im, k, axis=1) + rng.normal(scale=2, size=im.shape) for k in range(nframes)]
+    return np.clip(np.round(stack), 0, 255).astype(np.uint8)
+
+
+def bench(array, target):
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    blosc2_grok.set_params_defaults(target_ssim=target, irreversible=True, bit_depth=8)
+    blosc2_grok.get_quality_stats(reset=True)
+    t0 = time()
+    b2 = blosc2.asarray(array, chunks=(8,) + array.shape[1:], blocks=(1,) + array.shape[1:], cparams=cparams)
+    ctime = time() - t0
+    blosc2_grok.set_params_defaults()
+    return ctime, b2, blosc2_grok.get_quality_stats(reset=True)
+
+
+if __name__ == '__main__':
+    array = frames(NFRAMES)
+    mb = array.nbytes / 2**20
+    print(f"*** stack of {array.shape} frames")
+    for target in [0.95, 0.99, 0.995]:
+        ctime, b2, stats = bench(array, target)
+        print(f"target SSIM {target}: compress {mb / ctime:6.1f} MB/s, cratio {b2.schunk.cratio:6.2f}x, "
+              f"SSIM min {stats['min_ssim']:.4f} mean {stats['mean_ssim']:.4f}, "
+              f"{stats['passes'] / stats['blocks']:.1f} passes per block")
+        if structural_similarity is not None:
+            out = b2[...]
+            ssims = [structural_similarity(a, b, data_range=255) for a, b in zip(array, out)]
+            print(f"    scikit-image SSIM min {min(ssims):.4f} mean {np.mean(ssims):.4f}")
@@ -0,0 +1,64 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+"""
+Benchmark for rate correction.
+
+A stack of noisy, slowly changing frames is compressed in the rates quality
+mode, in chunks of several frames and with blocks of a quarter of a frame,
+with and without 'rate_correction'.  The overall ratio and the largest
+deviation of the ratio of a chunk from the target are printed.  Blocks are
+coded once either way, so the compression time is not compared.
+"""
+
+import blosc2
+import blosc2_grok
+import numpy as np
+from PIL import Image
+from pathlib import Path
+
+
+NFRAMES = 32
+project_dir = Path(__file__).parent.parent
+
+
+def frames(nframes, seed=0):
+    rng = np.random.default_rng(seed)
+    im = np.asarray(Image.open(project_dir / 'examples/kodim23.png').convert('L')).astype(np.float64)
+    stack = [np.roll(im, k, axis=1) + rng.normal(scale=2, size=im.shape) for k in range(nframes)]
+    return np.clip(np.round(stack), 0, 255).astype(np.uint8)
+
+
+def bench(array, rate, correction):
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    blosc2_grok.set_params_defaults(quality_mode='rates', quality_layers=np.array([rate], dtype=np.float64),
+                                    irreversible=True, rate_correction=correction)
+    chunks = (8,) + array.shape[1:]
+    blocks = (1, array.shape[1] // 2, array.shape[2] // 2)
+    b2 = blosc2.asarray(array, chunks=chunks, blocks=blocks, cparams=cparams)
+    blosc2_grok.set_params_defaults()
+    ratios = []
+    for nchunk in range(b2.schunk.nchunks):
+        nbytes, cbytes, _ = blosc2.get_cbuffer_sizes(b2.schunk.get_chunk(nchunk))
+        ratios.append(nbytes / cbytes)
+    deviation = max(abs(r - rate) / rate for r in ratios)
+    return b2.schunk.cratio, deviation
+
+
+if __name__ == '__main__':
+    array = frames(NFRAMES)
+    print(f"*** stack of {array.shape} frames")
+    for rate in [10, 20, 40]:
+        for correction in [False, True]:
+            cratio, deviation = bench(array, rate, correction)
+            print(f"rate {rate:3d}, correction {correction!s:5}: cratio {cratio:6.2f}x, "
+                  f"max deviation of a chunk {100 * deviation:5.1f}%")
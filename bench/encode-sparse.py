@@ -0,0 +1,70 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+"""
+Benchmark for sparse images.
+
+A mosaic of 128 x 128 blocks is compressed, where a given fraction of the
+blocks is uniform background (as masked regions or detector gaps are) and
+the rest are crops of a photo.  Uniform blocks are stored as their pixel,
+without grok, so the compression and decompression speeds should grow with
+the fraction of them.
+"""
+
+from time import time
+
+import blosc2
+import blosc2_grok
+import numpy as np
+from PIL import Image
+from pathlib import Path
+
+
+NREPS = 3
+BLOCK = 128
+project_dir = Path(__file__).parent.parent
+
+
+def mosaic(fraction, seed=0):
+    rng = np.random.default_rng(seed)
+    im = np.asarray(Image.open(project_dir / 'examples/kodim23.png').convert('L'))
+    ny, nx = im.shape[0] // BLOCK, im.shape[1] // BLOCK
+    out = np.full((4 * ny * BLOCK, 4 * nx * BLOCK), 17, dtype=np.uint16)
+    for j in range(4 * ny):
+        for i in range(4 * nx):
+            if rng.random() >= fraction:
+                y, x = (j % ny) * BLOCK, (i % nx) * BLOCK
+                out[j * BLOCK:(j + 1) * BLOCK, i * BLOCK:(i + 1) * BLOCK] = im[y:y + BLOCK, x:x + BLOCK]
+    return out
+
+
+def bench(array):
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    blosc2_grok.set_params_defaults()
+    ctime = dtime = np.inf
+    for _ in range(NREPS):
+        t0 = time()
+        b2 = blosc2.asarray(array, chunks=(4 * BLOCK, 4 * BLOCK), blocks=(BLOCK, BLOCK), cparams=cparams)
+        ctime = min(ctime, time() - t0)
+        t0 = time()
+        _ = b2[...]
+        dtime = min(dtime, time() - t0)
+    return ctime, dtime, b2.schunk.cratio
+
+
+if __name__ == '__main__':
+    for fraction in [0, 0.5, 0.9]:
+        array = mosaic(fraction)
+        mb = array.nbytes / 2**20
+        ctime, dtime, cratio = bench(array)
+        print(f"{100 * fraction:3.0f}% uniform blocks: compress {mb / ctime:7.1f} MB/s, "
+              f"decompress {mb / dtime:7.1f} MB/s, cratio {cratio:7.2f}x")
@@ -0,0 +1,73 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+"""
+Benchmark for the spectral decorrelation of blocks with many components.
+
+A synthetic hyperspectral cube (a scene whose pixels are mixtures of a few
+smooth spectra, plus sensor noise, as 12-bit samples) is compressed
+losslessly with several numbers of wavelet levels across the bands, and the
+ratio and the compression and decompression speeds (MB/s) are printed.
+"""
+
+from time import time
+
+import blosc2
+import blosc2_grok
+import numpy as np
+
+
+NREPS = 3
+NBANDS = 128
+SHAPE = (512, 512, NBANDS)
+BLOCKS = (128, 128, NBANDS)
+
+
+def hyperspectral_cube(shape, nmaterials=4, seed=0):
+    rng = np.random.default_rng(seed)
+    h, w, nbands = shape
+    wl = np.linspace(0, 1, nbands)
+    spectra = np.array([1 + np.sin(2 * np.pi * (f * wl + p)) for f, p in rng.uniform(0.3, 1.5, (nmaterials, 2))])
+    y, x = np.meshgrid(np.linspace(0, 1, h), np.linspace(0, 1, w), indexing='ij')
+    abundances = np.stack([np.sin(2 * np.pi * (fx * x + fy * y)) + 1.5
+                           for fx, fy in rng.uniform(1, 6, (nmaterials, 2))], axis=-1)
+    cube = abundances @ spectra
+    cube = cube / cube.max() * 4000 + rng.normal(scale=4, size=shape)
+    return np.clip(cube, 0, 4095).astype(np.uint16)
+
+
+def bench(array, levels):
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    blosc2_grok.set_params_defaults(spectral_levels=levels)
+    ctime = float('inf')
+    for _ in range(NREPS):
+        t0 = time()
+        b2 = blosc2.asarray(array, chunks=array.shape, blocks=BLOCKS, cparams=cparams)
+        ctime = min(ctime, time() - t0)
+    blosc2_grok.set_params_defaults()
+    dtime = float('inf')
+    for _ in range(NREPS):
+        t0 = time()
+        out = b2[...]
+        dtime = min(dtime, time() - t0)
+    np.testing.assert_array_equal(out, array)
+    return ctime, dtime, b2.schunk.cratio
+
+
+if __name__ == '__main__':
+    array = hyperspectral_cube(SHAPE)
+    mb = array.nbytes / 2**20
+    print(f"*** hyperspectral cube {array.shape}, blocks {BLOCKS}")
+    for levels in [0, 1, 3, 7]:
+        ctime, dtime, cratio = bench(array, levels)
+        print(f"spectral_levels {levels}: compress {mb / ctime:7.1f} MB/s, decompress {mb / dtime:7.1f} MB/s, "
+              f"cratio {cratio:6.2f}x")
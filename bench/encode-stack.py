@@ -0,0 +1,78 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+"""
+Benchmark for coding stacks of frames in a single block.
+
+A synthetic tomography stack (a slowly rotating phantom of a few ellipses,
+with Poisson noise, as 16-bit detector frames) is compressed losslessly with
+a frame per block, as `encode-blosc2.py` does, and with stacks of several
+frames per block, where every frame is predicted from the previous one.  The
+ratio and the compression and decompression speeds (MB/s) are printed.
+"""
+
+from time import time
+
+import blosc2
+import blosc2_grok
+import numpy as np
+
+
+NREPS = 3
+NFRAMES = 64
+FRAME = (512, 512)
+
+
+def phantom_stack(nframes, shape, seed=0):
+    rng = np.random.default_rng(seed)
+    y, x = np.meshgrid(np.linspace(-1, 1, shape[0]), np.linspace(-1, 1, shape[1]), indexing='ij')
+    ellipses = rng.uniform([-0.5, -0.5, 0.1, 0.1, 100], [0.5, 0.5, 0.4, 0.4, 400], (6, 5))
+    stack = []
+    for k in range(nframes):
+        angle = np.pi * k / (4 * nframes)
+        xr = x * np.cos(angle) - y * np.sin(angle)
+        yr = x * np.sin(angle) + y * np.cos(angle)
+        frame = np.full(shape, 1000.)
+        for cx, cy, a, b, value in ellipses:
+            frame += value * (((xr - cx) / a) ** 2 + ((yr - cy) / b) ** 2 <= 1)
+        stack.append(rng.poisson(frame))
+    return np.array(stack, dtype=np.uint16)
+
+
+def bench(array, blocks, **kwargs):
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    blosc2_grok.set_params_defaults(**kwargs)
+    chunks = (blocks[0] * 4,) + array.shape[1:]
+    ctime = float('inf')
+    for _ in range(NREPS):
+        t0 = time()
+        b2 = blosc2.asarray(array, chunks=chunks, blocks=blocks, cparams=cparams)
+        ctime = min(ctime, time() - t0)
+    blosc2_grok.set_params_defaults()
+    dtime = float('inf')
+    for _ in range(NREPS):
+        t0 = time()
+        out = b2[...]
+        dtime = min(dtime, time() - t0)
+    np.testing.assert_array_equal(out, array)
+    return ctime, dtime, b2.schunk.cratio
+
+
+if __name__ == '__main__':
+    array = phantom_stack(NFRAMES, FRAME)
+    mb = array.nbytes / 2**20
+    print(f"*** tomography stack {array.shape}")
+    for nframes in [1, 4, 8, 16]:
+        blocks = (nframes,) + FRAME
+        ctime, dtime, cratio = bench(array, blocks, layout="SHWC")
+        print(f"{nframes:2d} frames per block: compress {mb / ctime:7.1f} MB/s, "
+              f"decompress {mb / dtime:7.1f} MB/s, cratio {cratio:6.2f}x")
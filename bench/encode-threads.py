@@ -0,0 +1,70 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+"""
+Benchmark for the split of threads between blosc2 and grok.
+
+The same 64 images are compressed as a chunk with a single block (an 8x8
+mosaic of them) and as a chunk of 64 blocks (one image each), for several
+blosc2 `nthreads`, both with the fixed grok pool and with the
+automatic scheduler.  The throughput (MB/s) is printed for every combination.
+"""
+
+import os
+from pathlib import Path
+from time import time
+
+import blosc2
+import blosc2_grok
+import numpy as np
+from PIL import Image
+
+
+NIMAGES = 64
+NREPS = 3
+
+
+def bench(array, chunks, blocks, nthreads):
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'nthreads': nthreads,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    best = float('inf')
+    for _ in range(NREPS):
+        t0 = time()
+        blosc2.asarray(array, chunks=chunks, blocks=blocks, cparams=cparams)
+        best = min(best, time() - t0)
+    return array.nbytes / best / 2**20
+
+
+if __name__ == '__main__':
+    project_dir = Path(__file__).parent.parent
+    im = np.asarray(Image.open(project_dir / 'examples/kodim23.png'))
+    h, w, ncomps = im.shape
+
+    # 64 images, one per block
+    stack = np.stack([im] * NIMAGES)
+    # The same data as a single 8x8 mosaic, one block for the whole chunk
+    mosaic = stack.reshape(8, 8, h, w, ncomps).transpose(0, 2, 1, 3, 4).reshape(8 * h, 8 * w, ncomps)
+
+    cases = {
+        '1-block chunk': (mosaic, mosaic.shape, mosaic.shape),
+        '64-block chunk': (stack, stack.shape, (1,) + stack.shape[1:]),
+    }
+    ncores = os.cpu_count()
+    nthreads_list = sorted({1, 2, 4, 8, ncores})
+
+    for mode in blosc2_grok.SchedMode:
+        blosc2_grok.set_sched_mode(mode)
+        for name, (array, chunks, blocks) in cases.items():
+            print(f"*** {mode.name} scheduler, {name}")
+            for nthreads in nthreads_list:
+                speed = bench(array, chunks, blocks, nthreads)
+                print(f"nthreads={nthreads:3d}: {speed:8.1f} MB/s")
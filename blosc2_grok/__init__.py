@@ -12,6 +12,7 @@ import platform
 from enum import Enum
 from pathlib import Path
 import atexit
+import itertools
 import numpy as np
 
 __version__ = "0.3.4.dev0"
@@ -211,6 +212,15 @@ class GrkMode(Enum):
     JPH_RSIZ_FLAG = 0x4000  # for JPH, bit 14 of RSIZ must be set to 1
 
 
+class SchedMode(Enum):
+    """
+    How the size of the grok thread pool is chosen.
+    """
+
+    FIXED = 0  # the one in 'num_threads' (all the cores if 0)
+    AUTO = 1  # derived from the blosc2 nthreads and the number of blocks per chunk
+
+
 def get_libpath():
     system = platform.system()
     if system == "Linux":
@@ -276,6 +286,9 @@ def _add_windows_blosc2_dll_dirs():
 _add_windows_blosc2_dll_dirs()
 libpath = get_libpath()
 lib = ctypes.cdll.LoadLibrary(libpath)
+lib.blosc2_grok_max_layers.restype = ctypes.c_uint16
+# Largest number of quality layers of a block
+MAX_LAYERS = lib.blosc2_grok_max_layers()
 
 
 def print_libpath():
@@ -321,6 +334,20 @@ params_defaults = {
     'duration': 0,
     'repeats': 1,
     'verbose': False,
+    # 30 - 39
+    'headerless': False,
+    'writePLT': False,
+    'writeTLM': False,
+    'tiled_chunk': False,
+    'bit_depth': 0,
+    'float_error': 0.,
+    'float_rel_error': 0.,
+    'layout': "HWC",
+    # 40 - 49
+    'spectral_levels': 0,
+    'target_psnr': 0.,
+    'target_ssim': 0.,
+    'rate_correction': False,
 }
 
 
@@ -347,6 +374,9 @@ def set_params_defaults(**kwargs):
     # Prepare arguments
     params = params_defaults.copy()
     params.update(kwargs)
+    if params['layout'] not in ("HWC", "CHW", "SHWC"):
+        raise ValueError(f"Unknown layout: {params['layout']}")
+    params['layout'] = params['layout'].encode('utf-8')
     args = params.values()
     args = list(args)
 
@@ -372,8 +402,8 @@ def set_params_defaults(**kwargs):
     args[21] = args[21].value
     args[24] = args[24].value
 
-    if args[9] == GrkMode.HT and args[3] is not None:
-        raise ValueError("High throughput mode with quality mode activated is not currently supported.")
+    if args[9] == GrkMode.HT.value and args[3] == b"dB":
+        raise ValueError("High throughput mode only supports the 'rates' quality mode.")
 
     lib.blosc2_grok_set_default_params.argtypes = ([np.ctypeslib.ndpointer(dtype=np.int64)] * 2 +
                                                    [ctypes.c_int] + [ctypes.c_char_p] + [np.ctypeslib.ndpointer(dtype=np.float64)] +
@@ -384,10 +414,456 @@ def set_params_defaults(**kwargs):
                                                    [ctypes.c_int] +
                                                    [ctypes.c_int] + [ctypes.c_bool] +
                                                    [ctypes.c_int] * 5 + [ctypes.c_bool] +
-                                                   [ctypes.c_int] * 5 + [ctypes.c_bool])
+                                                   [ctypes.c_int] * 5 + [ctypes.c_bool] +
+                                                   [ctypes.c_bool] * 4 + [ctypes.c_int] +
+                                                   [ctypes.c_double] * 2 + [ctypes.c_char_p] +
+                                                   [ctypes.c_int] + [ctypes.c_double] * 2 + [ctypes.c_bool])
 
     lib.blosc2_grok_set_default_params(*args)
 
 
+def set_sched_mode(mode, ncores=0):
+    """
+    Set how the grok thread pool is sized.
+    :param mode: SchedMode
+        With SchedMode.AUTO, the cores are split between the blosc2 threads
+        (one block each) and the grok pool, depending on the blosc2 `nthreads`
+        and on the number of blocks per chunk.
+    :param ncores: int
+        Total number of cores to use in SchedMode.AUTO (0 means all of them).
+    :return: None
+    """
+    lib.blosc2_grok_set_sched_mode.argtypes = [ctypes.c_int, ctypes.c_uint32]
+    lib.blosc2_grok_set_sched_mode(mode.value, ncores)
+
+
+class _ArenaStats(ctypes.Structure):
+    _fields_ = [
+        ('image_hits', ctypes.c_uint64),
+        ('image_misses', ctypes.c_uint64),
+    ]
+
+
+def get_arena_stats(reset=False):
+    """
+    Get the reuse counters of the per-thread arenas of the encoder.
+    :param reset: bool
+        Reset the counters after reading them.
+    :return: dict
+        The number of blocks that reused (hits) or had to allocate (misses)
+        an image.
+    """
+    stats = _ArenaStats()
+    lib.blosc2_grok_get_arena_stats(ctypes.byref(stats))
+    if reset:
+        lib.blosc2_grok_reset_arena_stats()
+    return {name: getattr(stats, name) for name, _ in stats._fields_}
+
+
+class _QualityStats(ctypes.Structure):
+    _fields_ = [
+        ('blocks', ctypes.c_uint64),
+        ('passes', ctypes.c_uint64),
+        ('psnr_blocks', ctypes.c_uint64),
+        ('sum_psnr', ctypes.c_double),
+        ('min_psnr', ctypes.c_double),
+        ('sum_ssim', ctypes.c_double),
+        ('min_ssim', ctypes.c_double),
+    ]
+
+
+def get_quality_stats(reset=False):
+    """
+    Get the quality achieved by the blocks coded to a target PSNR or SSIM (see
+    'target_psnr' and 'target_ssim' in README.md).
+    :param reset: bool
+        Reset the counters after reading them.
+    :return: dict
+        The number of blocks, the encode and decode passes spent on them, and
+        the mean and minimum PSNR (mean of the blocks not coded losslessly) and
+        SSIM they achieved.
+    """
+    stats = _QualityStats()
+    lib.blosc2_grok_get_quality_stats(ctypes.byref(stats))
+    if reset:
+        lib.blosc2_grok_reset_quality_stats()
+    return {
+        'blocks': stats.blocks,
+        'passes': stats.passes,
+        'mean_psnr': stats.sum_psnr / stats.psnr_blocks if stats.psnr_blocks else float('inf'),
+        'min_psnr': stats.min_psnr if stats.blocks else float('inf'),
+        'mean_ssim': stats.sum_ssim / stats.blocks if stats.blocks else 1.,
+        'min_ssim': stats.min_ssim if stats.blocks else 1.,
+    }
+
+
+class _CacheStats(ctypes.Structure):
+    _fields_ = [
+        ('hits', ctypes.c_uint64),
+        ('misses', ctypes.c_uint64),
+        ('evictions', ctypes.c_uint64),
+        ('nbytes', ctypes.c_uint64),
+        ('nblocks', ctypes.c_uint64),
+    ]
+
+
+def set_decode_cache(nbytes):
+    """
+    Enable an LRU cache of decoded blocks, so that reading the same blocks again
+    costs a copy instead of a decode.
+    :param nbytes: int
+        Memory used by the cache at most.  0 (the default) disables it and drops
+        the cached blocks.
+    :return: None
+    """
+    lib.blosc2_grok_set_decode_cache.argtypes = [ctypes.c_int64]
+    lib.blosc2_grok_set_decode_cache(nbytes)
+
+
+def get_cache_stats(reset=False):
+    """
+    Get the counters of the cache of decoded blocks.
+    :param reset: bool
+        Reset the hits, misses and evictions counters after reading them.
+    :return: dict
+        The number of blocks found (hits) or not (misses) in the cache, of blocks
+        evicted, and the bytes and blocks currently cached.
+    """
+    stats = _CacheStats()
+    lib.blosc2_grok_get_cache_stats(ctypes.byref(stats))
+    if reset:
+        lib.blosc2_grok_reset_cache_stats()
+    return {name: getattr(stats, name) for name, _ in stats._fields_}
+
+
+class _TiledStats(ctypes.Structure):
+    _fields_ = [
+        ('chunks', ctypes.c_uint64),
+        ('unplaced', ctypes.c_uint64),
+        ('evictions', ctypes.c_uint64),
+        ('in_flight', ctypes.c_uint64),
+    ]
+
+
+def get_tiled_stats(reset=False):
+    """
+    Get the counters of the chunks coded with `tiled_chunk`.
+    :param reset: bool
+        Reset the chunks, unplaced and evictions counters after reading them.
+    :return: dict
+        The number of chunks coded as a single codestream, of blocks coded on
+        their own because too many chunks were in flight, of failed chunks
+        dropped to make room, and of chunks currently in flight.
+    """
+    stats = _TiledStats()
+    lib.blosc2_grok_get_tiled_stats(ctypes.byref(stats))
+    if reset:
+        lib.blosc2_grok_reset_tiled_stats()
+    return {name: getattr(stats, name) for name, _ in stats._fields_}
+
+
+class _DParams(ctypes.Structure):
+    _fields_ = [
+        ('reduce', ctypes.c_uint8),
+        ('x0', ctypes.c_uint32),
+        ('y0', ctypes.c_uint32),
+        ('x1', ctypes.c_uint32),
+        ('y1', ctypes.c_uint32),
+        ('layers', ctypes.c_uint16),
+        ('planes', ctypes.c_uint32),
+    ]
+
+
+def set_decode_layers(array, layers=None):
+    """
+    Decode the blocks of a grok compressed array with only their first quality layers.
+    This is stored in the 'grok_layers' vlmeta entry of the array, so it also applies
+    to regular blosc2 reads (e.g. `array[...]`) and is kept when the array is saved.
+    :param array: blosc2.NDArray
+    :param layers: int
+        Number of quality layers to decode.  None (or 0) decodes all of them.
+    :return: None
+    """
+    vlmeta = array.schunk.vlmeta
+    if not layers:
+        if 'grok_layers' in vlmeta:
+            del vlmeta['grok_layers']
+        return
+    if not 0 < layers <= MAX_LAYERS:
+        raise ValueError(f"The number of layers must be between 1 and {MAX_LAYERS}")
+    vlmeta['grok_layers'] = int(layers)
+
+
+def truncate_layers(array, layers=None, rate=None):
+    """
+    Shrink a grok compressed array in place by dropping the last quality layers of
+    its blocks.  Packets are just dropped (no decoding or coding), so this runs at
+    I/O speed.  The blocks need to be compressed with several `quality_layers`,
+    `writePLT=True` and the LRCP progression order (the default).
+    :param array: blosc2.NDArray
+    :param layers: int
+        Number of quality layers to keep.  None keeps all of them (or, with `rate`,
+        is the maximum to keep).
+    :param rate: float
+        Compression ratio that every block should reach: the most layers that
+        achieve it are kept (at least one).
+    :return: None
+    """
+    vlmeta = array.schunk.vlmeta
+    header = vlmeta['grok_header'] if 'grok_header' in vlmeta else None
+    lib.blosc2_grok_truncate_chunk.argtypes = ([ctypes.c_char_p, ctypes.c_int32] * 2 +
+                                               [ctypes.c_uint16, ctypes.c_double, ctypes.c_void_p, ctypes.c_int32])
+    for nchunk in range(array.schunk.nchunks):
+        chunk = array.schunk.get_chunk(nchunk)
+        dest = np.empty(len(chunk), dtype=np.uint8)
+        rc = lib.blosc2_grok_truncate_chunk(chunk, len(chunk), header, len(header) if header is not None else 0,
+                                            layers or 0, rate or 0, dest.ctypes.data, dest.nbytes)
+        if rc < 0:
+            raise RuntimeError(f"Error truncating chunk {nchunk}: {rc}")
+        if rc < len(chunk):
+            array.schunk.update_chunk(nchunk, dest[:rc].tobytes())
+
+
+def _decode_layers(array, layers):
+    if layers is not None:
+        return layers
+    vlmeta = array.schunk.vlmeta
+    return vlmeta['grok_layers'] if 'grok_layers' in vlmeta else 0
+
+
+def _layout(array):
+    """
+    Layout the blocks of the array were coded with: "HWC" (interleaved), "CHW" (planar)
+    or "SHWC" (stacks of frames).
+    """
+    vlmeta = array.schunk.vlmeta
+    return vlmeta['grok_layout'] if 'grok_layout' in vlmeta else "HWC"
+
+
+def _image_dims(blocks, layout="HWC"):
+    """
+    Dimensions of the arrays holding the rows, columns, components and frames of the images in
+    blocks (None if missing), as derived by the codec: leading dimensions equal to 1 are ignored.
+    Planar blocks have the components before the rows, and stacks the frames before the rows.
+    """
+    ndim = len(blocks)
+    igdim = 0
+    while igdim < ndim and blocks[igdim] == 1:
+        igdim += 1
+    dims = list(range(igdim, ndim))
+    if len(dims) > 4 or (len(dims) == 4 and layout != "SHWC"):
+        raise ValueError("Blocks with more than 3 non-unit dimensions are only supported as stacks")
+    if len(dims) == 1:
+        # A single row
+        return None, dims[0], None, None
+    if len(dims) >= 3 and layout == "SHWC":
+        return dims[1], dims[2], dims[3] if len(dims) == 4 else None, dims[0]
+    if len(dims) == 3 and layout == "CHW":
+        return dims[1], dims[2], dims[0], None
+    return tuple(dims + [None] * (3 - len(dims))) + (None,)
+
+
+def _image_planes(blocks, layout, compdim, framedim):
+    """
+    Number of planes (or frames) the codec decodes one after the other.
+    """
+    if framedim is not None:
+        return blocks[framedim]
+    if layout == "CHW" and compdim is not None:
+        return blocks[compdim]
+    return 0
+
+
+def _decode_block_into(array, chunk, header, nchunk, nblock, dparams, dest, dest_len, dest_stride):
+    """
+    Decode a block (or a window of it) into the memory at address `dest`, with a row
+    every `dest_stride` bytes (0 for packed rows).  Returns the width and height of
+    the decoded image.
+    """
+    layout = _layout(array)
+    rowdim, coldim, compdim, framedim = _image_dims(array.blocks, layout)
+    dparams.planes = _image_planes(array.blocks, layout, compdim, framedim)
+    bheight = array.blocks[rowdim] if rowdim is not None else 1
+    bwidth = array.blocks[coldim] if coldim is not None else 1
+    ncomps = array.blocks[compdim] if compdim is not None else 1
+    if framedim is not None:
+        ncomps *= array.blocks[framedim]
+    width = ctypes.c_uint32()
+    height = ctypes.c_uint32()
+
+    lib.blosc2_grok_decode_block.argtypes = ([ctypes.c_char_p] + [ctypes.c_int32] * 2 + [ctypes.c_uint32] * 3 +
+                                             [ctypes.c_char_p, ctypes.c_int32, ctypes.POINTER(_DParams),
+                                              ctypes.c_void_p, ctypes.c_int64, ctypes.c_int64] +
+                                             [ctypes.POINTER(ctypes.c_uint32)] * 2)
+    lib.blosc2_grok_decode_block.restype = ctypes.c_int64
+    rc = lib.blosc2_grok_decode_block(chunk, len(chunk), nblock, bwidth, bheight, ncomps,
+                                      header, len(header) if header is not None else 0, ctypes.byref(dparams),
+                                      dest, dest_len, dest_stride, ctypes.byref(width), ctypes.byref(height))
+    if rc < 0:
+        raise RuntimeError(f"Error decoding block {nblock} of chunk {nchunk}: {rc}")
+    return width.value, height.value
+
+
+def decode_block(array, nchunk, nblock, reduce=0, window=None, layers=None):
+    """
+    Decode a block of a grok compressed array.
+    :param array: blosc2.NDArray
+    :param nchunk: int
+        Number of the chunk in the array.
+    :param nblock: int
+        Number of the block in the chunk.
+    :param reduce: int
+        Number of resolution levels to discard: the image in the block is 2**reduce
+        times smaller along rows and columns (rounding up).  Must be lower than
+        'num_resolutions'.
+    :param window: tuple
+        ((row_start, row_stop), (col_start, col_stop)) region of the block to decode, in
+        full resolution pixels.  Only the code-blocks overlapping it are decoded.  None
+        decodes the whole block.
+    :param layers: int
+        Number of quality layers to decode (0 for all of them).  None uses the setting
+        of the array (see `set_decode_layers`).
+    :return: np.ndarray
+        The block, with the shape of the array blocks, except for the rows and columns,
+        which are those of the (reduced) window.
+    """
+    rowdim, coldim, _, _ = _image_dims(array.blocks, _layout(array))
+    dparams = _DParams(reduce=reduce, layers=_decode_layers(array, layers))
+    if window is not None:
+        (dparams.y0, dparams.y1), (dparams.x0, dparams.x1) = window
+
+    vlmeta = array.schunk.vlmeta
+    header = vlmeta['grok_header'] if 'grok_header' in vlmeta else None
+    chunk = array.schunk.get_chunk(nchunk)
+    dest = np.empty(np.prod(array.blocks), dtype=array.dtype)
+    width, height = _decode_block_into(array, chunk, header, nchunk, nblock, dparams,
+                                       dest.ctypes.data, dest.nbytes, 0)
+
+    shape = list(array.blocks)
+    if rowdim is not None:
+        shape[rowdim] = height
+    if coldim is not None:
+        shape[coldim] = width
+    return dest[:np.prod(shape)].reshape(shape)
+
+
+def get_slice(array, key=None, reduce=0, layers=None):
+    """
+    Get a slice of a grok compressed array, possibly at a reduced resolution.  Only
+    the blocks that intersect the slice are decoded and, inside them, only the
+    code-blocks overlapping the slice, up to the requested resolution level.  The
+    blocks are decoded straight into the returned array.
+    :param array: blosc2.NDArray
+    :param key: int, slice or tuple of them
+        The slice, in full resolution coordinates.  Steps are not supported.
+    :param reduce: int
+        Number of resolution levels to discard (see `decode_block`).  Block
+        rows and columns should be multiples of 2**reduce.
+    :param layers: int
+        Number of quality layers to decode (see `decode_block`).
+    :return: np.ndarray
+        The slice, 2**reduce times smaller along rows and columns: a [start, stop)
+        range becomes [ceil(start / 2**reduce), ceil(stop / 2**reduce)).
+    """
+    shape, chunks, blocks = array.shape, array.chunks, array.blocks
+    ndim = len(shape)
+    if key is None:
+        key = ()
+    if not isinstance(key, tuple):
+        key = (key,)
+    key = key + (slice(None),) * (ndim - len(key))
+    start, stop, squeeze = [], [], []
+    for i, (k, n) in enumerate(zip(key, shape)):
+        if isinstance(k, slice):
+            k0, k1, step = k.indices(n)
+            if step != 1:
+                raise ValueError("Steps are not supported")
+        else:
+            k0 = k + n if k < 0 else k
+            k1 = k0 + 1
+            squeeze.append(i)
+        start.append(k0)
+        stop.append(max(k0, k1))
+
+    layout = _layout(array)
+    rowdim, coldim, compdim, framedim = _image_dims(blocks, layout)
+    planes = _image_planes(blocks, layout, compdim, framedim)
+    reduced = [d for d in (rowdim, coldim) if d is not None]
+    scale = 1 << reduce
+    rstart, rstop = list(start), list(stop)
+    for d in reduced:
+        rstart[d] = -(-start[d] // scale)
+        rstop[d] = -(-stop[d] // scale)
+    out = np.zeros([e - b for b, e in zip(rstart, rstop)], dtype=array.dtype)
+    if out.size == 0:
+        return np.squeeze(out, axis=tuple(squeeze))
+
+    # Blocks holding all the components of the slice go straight into `out`, unless
+    # they are planar or stacks (planes and frames are decoded one after the other)
+    direct = planes == 0 and (compdim is None or (start[compdim] == 0 and stop[compdim] == blocks[compdim]))
+    row_stride = out.strides[rowdim] if rowdim is not None else 0
+
+    vlmeta = array.schunk.vlmeta
+    header = vlmeta['grok_header'] if 'grok_header' in vlmeta else None
+    layers = _decode_layers(array, layers)
+    nchunks = [-(-n // c) for n, c in zip(shape, chunks)]
+    nblocks = [-(-c // b) for c, b in zip(chunks, blocks)]
+    chunk_ranges = [range(b // c, (e - 1) // c + 1) for b, e, c in zip(start, stop, chunks)]
+    for cidx in itertools.product(*chunk_ranges):
+        nchunk = int(np.ravel_multi_index(cidx, nchunks))
+        chunk = array.schunk.get_chunk(nchunk)
+        corigin = [i * c for i, c in zip(cidx, chunks)]
+        block_ranges = [range((max(b, o) - o) // bs, (min(e, o + c) - 1 - o) // bs + 1)
+                        for b, e, o, c, bs in zip(start, stop, corigin, chunks, blocks)]
+        for bidx in itertools.product(*block_ranges):
+            nblock = int(np.ravel_multi_index(bidx, nblocks))
+            # The window of the block inside the slice, and where it goes in `out`
+            lo, hi, dst = [], [], []
+            for d in range(ndim):
+                borigin = corigin[d] + bidx[d] * blocks[d]
+                lo.append(max(start[d], borigin) - borigin)
+                hi.append(min(stop[d], borigin + blocks[d]) - borigin)
+                if d in reduced:
+                    dst.append(-(-(borigin + lo[d]) // scale) - rstart[d])
+                else:
+                    dst.append(borigin + lo[d] - start[d])
+            dparams = _DParams(reduce=reduce, layers=layers)
+            if rowdim is not None:
+                dparams.y0, dparams.y1 = lo[rowdim], hi[rowdim]
+            else:
+                dparams.y0, dparams.y1 = 0, 1
+            if coldim is not None:
+                dparams.x0, dparams.x1 = lo[coldim], hi[coldim]
+            else:
+                dparams.x0, dparams.x1 = 0, 1
+
+            if direct:
+                if compdim is not None:
+                    dst[compdim] = 0
+                offset = sum(i * s for i, s in zip(dst, out.strides))
+                _decode_block_into(array, chunk, header, nchunk, nblock, dparams,
+                                   out.ctypes.data + offset, out.nbytes - offset, row_stride)
+            else:
+                tmp = np.empty(np.prod(blocks), dtype=array.dtype)
+                width, height = _decode_block_into(array, chunk, header, nchunk, nblock, dparams,
+                                                   tmp.ctypes.data, tmp.nbytes, 0)
+                # The decoded dimensions come in the same order as in the array
+                dims = sorted(d for d in (rowdim, coldim, compdim, framedim) if d is not None)
+                tshape = [height if d == rowdim else width if d == coldim else blocks[d] for d in dims]
+                tmp = tmp[:np.prod(tshape)].reshape(tshape)
+                tmp = tmp[tuple(slice(lo[d], hi[d]) if d in (compdim, framedim) else slice(None) for d in dims)]
+                region = [slice(i, i + 1) for i in dst]
+                if rowdim is not None:
+                    region[rowdim] = slice(dst[rowdim], dst[rowdim] + height)
+                if coldim is not None:
+                    region[coldim] = slice(dst[coldim], dst[coldim] + width)
+                for d in (compdim, framedim):
+                    if d is not None:
+                        region[d] = slice(dst[d], dst[d] + hi[d] - lo[d])
+                out[tuple(region)] = tmp.reshape(out[tuple(region)].shape)
+
+    return np.squeeze(out, axis=tuple(squeeze))
+
+
 if __name__ == "__main__":
     print_libpath()
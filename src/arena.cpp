@@ -0,0 +1,128 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "blosc2_grok.h"
+#include "arena.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+static std::atomic<uint64_t> image_hits{0};
+static std::atomic<uint64_t> image_misses{0};
+
+
+static bool use_huge_pages() {
+    static const bool huge = [] {
+        const char *env = getenv("BLOSC2_GROK_HUGEPAGES");
+        return env != nullptr && strcmp(env, "1") == 0;
+    }();
+    return huge;
+}
+
+
+// Advise the kernel to back the whole pages inside [ptr, ptr + len) with huge pages
+static void advise_huge_pages(void *ptr, size_t len) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (!use_huge_pages() || len < HUGE_PAGE_SIZE) {
+        return;
+    }
+    auto start = ((uintptr_t)ptr + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    auto end = ((uintptr_t)ptr + len) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    if (end > start) {
+        madvise((void *)start, end - start, MADV_HUGEPAGE);
+    }
+#else
+    (void)ptr;
+    (void)len;
+#endif
+}
+
+
+struct arena {
+    grk_image *image = nullptr;
+
+    ~arena() {
+        grk_object_unref(image ? &image->obj : nullptr);
+    }
+};
+
+static thread_local arena local_arena;
+
+
+static bool image_matches(const grk_image *image, uint32_t numComps, uint32_t width, uint32_t height) {
+    if (image->numcomps != numComps) {
+        return false;
+    }
+    for (uint32_t compno = 0; compno < numComps; ++compno) {
+        const grk_image_comp *comp = image->comps + compno;
+        if (comp->w != width || comp->h != height || comp->data == nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+grk_image *get_arena_image(uint32_t numComps, uint32_t width, uint32_t height, uint32_t precision, bool sgnd) {
+    arena &a = local_arena;
+    if (a.image != nullptr && image_matches(a.image, numComps, width, height)) {
+        image_hits.fetch_add(1, std::memory_order_relaxed);
+        for (uint32_t compno = 0; compno < numComps; ++compno) {
+            a.image->comps[compno].prec = precision;
+            a.image->comps[compno].sgnd = sgnd;
+        }
+        grk_object_ref(&a.image->obj);
+        return a.image;
+    }
+    image_misses.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<grk_image_comp> components(numComps);
+    memset(components.data(), 0, numComps * sizeof(grk_image_comp));
+    for (auto &c : components) {
+        c.w = width;
+        c.h = height;
+        c.dx = 1;
+        c.dy = 1;
+        c.prec = precision;
+        c.sgnd = sgnd;
+    }
+    grk_image *image = grk_image_new(numComps, components.data(),
+                                     numComps == 1 ? GRK_CLRSPC_GRAY : GRK_CLRSPC_SRGB, true);
+    if (image == nullptr) {
+        return nullptr;
+    }
+    for (uint32_t compno = 0; compno < numComps; ++compno) {
+        const grk_image_comp *comp = image->comps + compno;
+        advise_huge_pages(comp->data, (size_t)comp->stride * comp->h * sizeof(int32_t));
+    }
+
+    // The arena keeps its own reference
+    grk_object_unref(a.image ? &a.image->obj : nullptr);
+    a.image = image;
+    grk_object_ref(&image->obj);
+    return image;
+}
+
+
+void blosc2_grok_get_arena_stats(blosc2_grok_arena_stats *stats) {
+    stats->image_hits = image_hits.load(std::memory_order_relaxed);
+    stats->image_misses = image_misses.load(std::memory_order_relaxed);
+}
+
+
+void blosc2_grok_reset_arena_stats() {
+    image_hits = 0;
+    image_misses = 0;
+}
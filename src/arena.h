@@ -0,0 +1,30 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#ifndef BLOSC2_GROK_ARENA_H
+#define BLOSC2_GROK_ARENA_H
+
+#include <cstdint>
+
+#include "grok.h"
+
+// Per-thread arenas for the big allocations of every block: the grok image
+// with its component planes.  Blocks of an array all have the same geometry,
+// so after the first block of a thread the image is reused instead of
+// allocated, page-faulted and freed again.
+//
+// Set BLOSC2_GROK_HUGEPAGES=1 to ask the kernel for transparent huge pages
+// on the image planes (Linux only).
+
+// Get an image of this geometry, with allocated planes.  The caller owns a
+// reference and must release it with grk_object_unref.  Plane contents are
+// undefined.  As planes are int32 anyway, an image is reused whatever its
+// precision and signedness, which are just set to the requested ones.
+grk_image *get_arena_image(uint32_t numComps, uint32_t width, uint32_t height, uint32_t precision, bool sgnd);
+
+#endif
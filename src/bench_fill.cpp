@@ -0,0 +1,155 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+
+Micro-benchmark for the fill stage of the encoder (deinterleaving the
+input block into the grok image planes), compared with the whole encode.
+
+Compile this program with cmake and run:
+$ ./bench_fill
+
+For every (typesize, components) pair it prints the time of the legacy
+fill loop, of the SIMD kernels and of a full encode, and the share of the
+fill stage in the encode time before and after.  Set BLOSC2_GROK_SIMD=scalar
+to time the portable kernels instead.
+
+**********************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "grok.h"
+#include "kernels.h"
+
+#define DIMX 2048
+#define DIMY 2048
+#define NREPS 10
+
+
+static double now_ms() {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// The fill loop as it was before the kernels: per-sample memcpy into a
+// scratch plane, then a second pass copying it into the image.
+static void legacy_fill(const uint8_t *input, grk_image *image, uint32_t typesize) {
+    uint32_t numComps = image->numcomps;
+    for (uint16_t compno = 0; compno < numComps; ++compno) {
+        uint64_t index = compno;
+        auto comp = image->comps + compno;
+        auto srcData = new int32_t[comp->w * comp->h];
+        memset(srcData, 0, comp->w * comp->h * sizeof(int32_t));
+        for (uint32_t j = 0; j < comp->h; ++j) {
+            for (uint32_t i = 0; i < comp->w; ++i) {
+                memcpy(srcData + j * comp->w + i, &input[index * typesize], typesize);
+                index += numComps;
+            }
+        }
+        auto srcPtr = srcData;
+        auto compData = comp->data;
+        for (uint32_t j = 0; j < comp->h; ++j) {
+            memcpy(compData, srcPtr, comp->w * sizeof(int32_t));
+            srcPtr += comp->w;
+            compData += comp->stride;
+        }
+        delete[] srcData;
+    }
+}
+
+
+static void kernel_fill(const uint8_t *input, grk_image *image, uint32_t typesize) {
+    uint32_t numComps = image->numcomps;
+    fill_row_fn fill_row = get_fill_kernel(typesize, numComps, false);
+    std::vector<int32_t *> rows(numComps);
+    for (uint32_t j = 0; j < image->comps[0].h; ++j) {
+        for (uint32_t c = 0; c < numComps; ++c) {
+            rows[c] = image->comps[c].data + (size_t)j * image->comps[c].stride;
+        }
+        fill_row(input, rows.data(), image->comps[0].w, numComps);
+        input += (size_t)image->comps[0].w * numComps * typesize;
+    }
+}
+
+
+static int bench(uint32_t typesize, uint32_t numComps) {
+    size_t nbytes = (size_t)DIMX * DIMY * numComps * typesize;
+    auto input = std::make_unique<uint8_t[]>(nbytes);
+    // A smooth gradient, so that the encoder does some real work
+    for (size_t i = 0; i < nbytes; ++i) {
+        input[i] = (uint8_t)((i / numComps / typesize) % DIMX / 8 + i % 3);
+    }
+
+    std::vector<grk_image_comp> components(numComps);
+    memset(components.data(), 0, numComps * sizeof(grk_image_comp));
+    for (auto &c : components) {
+        c.w = DIMX;
+        c.h = DIMY;
+        c.dx = 1;
+        c.dy = 1;
+        c.prec = 8 * typesize;
+        c.sgnd = false;
+    }
+    grk_image *image = grk_image_new(numComps, components.data(),
+                                     numComps == 1 ? GRK_CLRSPC_GRAY : GRK_CLRSPC_SRGB, true);
+
+    double t0 = now_ms();
+    for (int i = 0; i < NREPS; ++i) {
+        legacy_fill(input.get(), image, typesize);
+    }
+    double legacy = (now_ms() - t0) / NREPS;
+
+    t0 = now_ms();
+    for (int i = 0; i < NREPS; ++i) {
+        kernel_fill(input.get(), image, typesize);
+    }
+    double kernel = (now_ms() - t0) / NREPS;
+
+    grk_cparameters compressParams;
+    grk_compress_set_default_params(&compressParams);
+    compressParams.cod_format = GRK_FMT_JP2;
+    grk_stream_params streamParams;
+    grk_set_default_stream_params(&streamParams);
+    auto buf = std::make_unique<uint8_t[]>(nbytes);
+    streamParams.buf = buf.get();
+    streamParams.buf_len = nbytes;
+    t0 = now_ms();
+    grk_codec *codec = grk_compress_init(&streamParams, &compressParams, image);
+    uint64_t size = codec ? grk_compress(codec, nullptr) : 0;
+    double encode = now_ms() - t0;
+    grk_object_unref(codec);
+    grk_object_unref(&image->obj);
+    if (size == 0) {
+        fprintf(stderr, "Failed to compress\n");
+        return -1;
+    }
+
+    printf("uint%-2d x %d comps: legacy fill %6.2f ms, kernel fill %6.2f ms, encode %6.1f ms "
+           "-> fill share %.1f%% -> %.1f%%\n",
+           8 * typesize, numComps, legacy, kernel, encode,
+           100 * legacy / (legacy + encode), 100 * kernel / (kernel + encode));
+    return 0;
+}
+
+
+int main(void) {
+    grk_initialize(nullptr, 0, false);
+    printf("SIMD kernels: %s\n", get_simd_name());
+
+    int error = 0;
+    for (uint32_t typesize = 1; typesize <= 2; ++typesize) {
+        for (uint32_t numComps : {1, 3, 4}) {
+            error |= bench(typesize, numComps);
+        }
+    }
+
+    grk_deinitialize();
+    return error;
+}
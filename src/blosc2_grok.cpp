@@ -6,25 +6,95 @@
  * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
 **********************************************************************/
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "blosc2_grok.h"
 #include "blosc2_grok_public.h"
+#include "arena.h"
+#include "cache.h"
+#include "codestream.h"
+#include "context.h"
+#include "kernels.h"
+#include "pool.h"
+#include "quality.h"
+#include "tag.h"
+#include "tiled.h"
+#include "transcode.h"
 
-static grk_cparameters GRK_CPARAMETERS_DEFAULTS = {0};
-static bool GRK_INITIALIZED = false;
+// Defaults for the encoder: the grok parameters plus the options of the plugin
+struct grok_defaults {
+    grk_cparameters compressParams;
+    bool headerless;    // store the main header once in vlmeta, not in every block
+    bool tiled_chunk;   // code every chunk as a single codestream, with a tile per block
+    uint32_t bit_depth; // precision of the samples, or 0 to find it for every block
+    double float_error;      // absolute error bound for float32 samples (0 for none)
+    double float_rel_error;  // error bound relative to the range of every block (0 for none)
+    bool planar;        // blocks with 3 non-unit dimensions are (C, H, W), not (H, W, C)
+    bool stack;         // blocks with 3 or 4 non-unit dimensions are stacks of frames (S, H, W[, C])
+    uint32_t spectral_levels;  // levels of the wavelet across components (0 for none)
+    double target_psnr;  // code every block at the highest rate reaching this quality (0 for none)
+    double target_ssim;
+    bool rate_correction;  // correct the rates of a block by what grok achieved for the previous one
+};
 
+// The defaults are an immutable snapshot: setting new defaults publishes a
+// new one, and every encoder call works on its own copy.
+static std::mutex GRK_MUTEX;
+static std::shared_ptr<const grok_defaults> GRK_DEFAULTS;
+static std::atomic<bool> GRK_INITIALIZED{false};
 
-void blosc2_grok_init(uint32_t nthreads, bool verbose) {
+
+// GRK_MUTEX must be held
+static void grok_init(uint32_t nthreads, bool verbose) {
     // initialize library
-    grk_initialize(nullptr, nthreads, verbose);
+    init_grok_pool(nthreads, verbose);
     // set default parameters
-    grk_compress_set_default_params(&GRK_CPARAMETERS_DEFAULTS);
-    GRK_CPARAMETERS_DEFAULTS.cod_format = GRK_FMT_JP2;
+    auto defaults = std::make_shared<grok_defaults>();
+    grk_compress_set_default_params(&defaults->compressParams);
+    defaults->compressParams.cod_format = GRK_FMT_JP2;
+    defaults->headerless = false;
+    defaults->tiled_chunk = false;
+    defaults->bit_depth = 0;
+    defaults->float_error = 0;
+    defaults->float_rel_error = 0;
+    defaults->planar = false;
+    defaults->stack = false;
+    defaults->spectral_levels = 0;
+    defaults->target_psnr = 0;
+    defaults->target_ssim = 0;
+    defaults->rate_correction = false;
+    GRK_DEFAULTS = defaults;
     GRK_INITIALIZED = true;
 }
 
 
+static void ensure_initialized() {
+    if (!GRK_INITIALIZED) {
+        std::lock_guard<std::mutex> lock(GRK_MUTEX);
+        if (!GRK_INITIALIZED) {
+            grok_init(0, false);
+        }
+    }
+}
+
+
+static std::shared_ptr<const grok_defaults> get_defaults() {
+    std::lock_guard<std::mutex> lock(GRK_MUTEX);
+    return GRK_DEFAULTS;
+}
+
+
+void blosc2_grok_init(uint32_t nthreads, bool verbose) {
+    std::lock_guard<std::mutex> lock(GRK_MUTEX);
+    grok_init(nthreads, verbose);
+}
+
+
 void blosc2_grok_set_default_params(const int64_t *tile_size, const int64_t *tile_offset,
                                     int numlayers, char *quality_mode, const double *quality_layers,
                                     int numgbits, char *progression,
@@ -38,319 +108,1257 @@ void blosc2_grok_set_default_params(const int64_t *tile_size, const int64_t *til
                                     bool apply_icc_,
                                     GRK_RATE_CONTROL_ALGORITHM rateControlAlgorithm, int num_threads, int deviceId,
                                     int duration, int repeats,
-                                    bool verbose) {
-    if (!GRK_INITIALIZED) {
-        blosc2_grok_init(0, false);
-    }
+                                    bool verbose, bool headerless, bool writePLT, bool writeTLM,
+                                    bool tiled_chunk, int bit_depth, double float_error, double float_rel_error,
+                                    char *layout, int spectral_levels, double target_psnr, double target_ssim,
+                                    bool rate_correction) {
+    ensure_initialized();
 
-    // Change defaults
+    // Change defaults on a copy of the current ones, and publish it at the end
+    grok_defaults defaults = *get_defaults();
+    grk_cparameters &params = defaults.compressParams;
     if (tile_size[0] == 0 && tile_size[1] == 0) {
-        GRK_CPARAMETERS_DEFAULTS.tile_size_on = false;
+        params.tile_size_on = false;
     } else {
-        GRK_CPARAMETERS_DEFAULTS.tile_size_on = true;
+        params.tile_size_on = true;
     }
-    GRK_CPARAMETERS_DEFAULTS.tx0 = tile_offset[0];
-    GRK_CPARAMETERS_DEFAULTS.ty0 = tile_offset[1];
-    GRK_CPARAMETERS_DEFAULTS.t_width = tile_size[0];
-    GRK_CPARAMETERS_DEFAULTS.t_height = tile_size[1];
+    params.tx0 = tile_offset[0];
+    params.ty0 = tile_offset[1];
+    params.t_width = tile_size[0];
+    params.t_height = tile_size[1];
 
-    GRK_CPARAMETERS_DEFAULTS.numlayers = numlayers;
+    params.numlayers = numlayers;
     // Restore default values
-    GRK_CPARAMETERS_DEFAULTS.allocationByRateDistoration = false;
-    GRK_CPARAMETERS_DEFAULTS.allocationByQuality = false;
+    params.allocationByRateDistoration = false;
+    params.allocationByQuality = false;
     if (quality_mode != nullptr) {
         if (strcmp(quality_mode, "rates") == 0) {
-            GRK_CPARAMETERS_DEFAULTS.allocationByRateDistoration = true;
+            params.allocationByRateDistoration = true;
             for (int i = 0; i < numlayers; ++i) {
-                GRK_CPARAMETERS_DEFAULTS.layer_rate[i] = quality_layers[i];
+                params.layer_rate[i] = quality_layers[i];
             }
         } else if (strcmp(quality_mode, "dB") == 0) {
-            GRK_CPARAMETERS_DEFAULTS.allocationByQuality = true;
+            params.allocationByQuality = true;
             for (int i = 0; i < numlayers; ++i) {
-                GRK_CPARAMETERS_DEFAULTS.layer_distortion[i] = quality_layers[i];
+                params.layer_distortion[i] = quality_layers[i];
             }
         }
     }
 
     /*for (int i = 0; i < GRK_NUM_COMMENTS_SUPPORTED; ++i) {
-        GRK_CPARAMETERS_DEFAULTS.comment[i] = comment[i]; // malloc & memcpy
-        GRK_CPARAMETERS_DEFAULTS.comment_len[i] = comment_len[i];
-        GRK_CPARAMETERS_DEFAULTS.is_binary_comment[i] = is_binary_comment[i];
+        params.comment[i] = comment[i]; // malloc & memcpy
+        params.comment_len[i] = comment_len[i];
+        params.is_binary_comment[i] = is_binary_comment[i];
     }
-    GRK_CPARAMETERS_DEFAULTS.num_comments = num_comments;*/
+    params.num_comments = num_comments;*/
 
-    // GRK_CPARAMETERS_DEFAULTS.csty = csty;
-    GRK_CPARAMETERS_DEFAULTS.numgbits = numgbits;
+    // params.csty = csty;
+    params.numgbits = numgbits;
     if (strcmp(progression, "LRCP") == 0) {
-        GRK_CPARAMETERS_DEFAULTS.prog_order = GRK_LRCP;
+        params.prog_order = GRK_LRCP;
     } else if (strcmp(progression, "RLCP") == 0) {
-        GRK_CPARAMETERS_DEFAULTS.prog_order = GRK_RLCP;
+        params.prog_order = GRK_RLCP;
     } else if (strcmp(progression, "RPCL") == 0) {
-        GRK_CPARAMETERS_DEFAULTS.prog_order = GRK_RPCL;
+        params.prog_order = GRK_RPCL;
     } else if (strcmp(progression, "PCRL") == 0) {
-        GRK_CPARAMETERS_DEFAULTS.prog_order = GRK_PCRL;
+        params.prog_order = GRK_PCRL;
     } else if (strcmp(progression, "CPRL") == 0) {
-        GRK_CPARAMETERS_DEFAULTS.prog_order = GRK_CPRL;
+        params.prog_order = GRK_CPRL;
     }
 
     //for (int i = 0; i < res_spec; ++i) {
-    // GRK_CPARAMETERS_DEFAULTS.progression[i] = progression[i];
+    // params.progression[i] = progression[i];
     // }
     if (precinct_size[0] != 0 && precinct_size[1] != 0) {
-        GRK_CPARAMETERS_DEFAULTS.res_spec = 1; // grok can support more than one, but PIL not.
+        params.res_spec = 1; // grok can support more than one, but PIL not.
     } else {
-        GRK_CPARAMETERS_DEFAULTS.res_spec = 0;
+        params.res_spec = 0;
     }
-    GRK_CPARAMETERS_DEFAULTS.prcw_init[0] = precinct_size[0];
-    GRK_CPARAMETERS_DEFAULTS.prch_init[0] = precinct_size[1];
-    // GRK_CPARAMETERS_DEFAULTS.numpocs = numpocs; only one prog supported
-    GRK_CPARAMETERS_DEFAULTS.numresolution = num_resolutions;
+    params.prcw_init[0] = precinct_size[0];
+    params.prch_init[0] = precinct_size[1];
+    // params.numpocs = numpocs; only one prog supported
+    params.numresolution = num_resolutions;
 
-    GRK_CPARAMETERS_DEFAULTS.cblockw_init = codeblock_size[0];
-    GRK_CPARAMETERS_DEFAULTS.cblockh_init = codeblock_size[1];
+    params.cblockw_init = codeblock_size[0];
+    params.cblockh_init = codeblock_size[1];
 
 
-    GRK_CPARAMETERS_DEFAULTS.irreversible = irreversible;
-    GRK_CPARAMETERS_DEFAULTS.roi_compno = roi_compno;
-    GRK_CPARAMETERS_DEFAULTS.roi_shift = roi_shift;
+    params.irreversible = irreversible;
+    params.roi_compno = roi_compno;
+    params.roi_shift = roi_shift;
 
-    GRK_CPARAMETERS_DEFAULTS.cblk_sty = cblk_style;
+    params.cblk_sty = cblk_style;
 
-    GRK_CPARAMETERS_DEFAULTS.image_offset_x0 = offset[0];
-    GRK_CPARAMETERS_DEFAULTS.image_offset_y0 = offset[1];
-    // GRK_CPARAMETERS_DEFAULTS.subsampling_dx = subsampling_dx;
-    // GRK_CPARAMETERS_DEFAULTS.subsampling_dy = subsampling_dy;
+    params.image_offset_x0 = offset[0];
+    params.image_offset_y0 = offset[1];
+    // params.subsampling_dx = subsampling_dx;
+    // params.subsampling_dy = subsampling_dy;
 
-    GRK_CPARAMETERS_DEFAULTS.decod_format = decod_format;
-    GRK_CPARAMETERS_DEFAULTS.cod_format = cod_format;
-    // GRK_CPARAMETERS_DEFAULTS.raw_cp = raw_cp;
-    GRK_CPARAMETERS_DEFAULTS.enableTilePartGeneration = enableTilePartGeneration;
-    // GRK_CPARAMETERS_DEFAULTS.newTilePartProgressionDivider = newTilePartProgressionDivider;
-    GRK_CPARAMETERS_DEFAULTS.mct = mct;
+    params.decod_format = decod_format;
+    params.cod_format = cod_format;
+    // params.raw_cp = raw_cp;
+    params.enableTilePartGeneration = enableTilePartGeneration;
+    // params.newTilePartProgressionDivider = newTilePartProgressionDivider;
+    params.mct = mct;
 
-    // GRK_CPARAMETERS_DEFAULTS.mct_data = mct_data;
-    GRK_CPARAMETERS_DEFAULTS.max_cs_size = max_cs_size;
+    // params.mct_data = mct_data;
+    params.max_cs_size = max_cs_size;
 
-    GRK_CPARAMETERS_DEFAULTS.max_comp_size = max_comp_size;
-    GRK_CPARAMETERS_DEFAULTS.rsiz = rsiz;
-    GRK_CPARAMETERS_DEFAULTS.framerate = framerate;
+    params.max_comp_size = max_comp_size;
+    params.rsiz = rsiz;
+    params.framerate = framerate;
 
     /*for (int i = 0; i < 2; ++i) {
-        GRK_CPARAMETERS_DEFAULTS.capture_resolution_from_file[i] = capture_resolution_from_file[i];
-        GRK_CPARAMETERS_DEFAULTS.capture_resolution[i] = capture_resolution[i];
-        GRK_CPARAMETERS_DEFAULTS.display_resolution[i] = display_resolution[i];
-    }
-    GRK_CPARAMETERS_DEFAULTS.write_capture_resolution_from_file = write_capture_resolution_from_file;
-    GRK_CPARAMETERS_DEFAULTS.write_capture_resolution = write_capture_resolution;
-    GRK_CPARAMETERS_DEFAULTS.write_display_resolution = write_display_resolution;*/
-    GRK_CPARAMETERS_DEFAULTS.apply_icc_ = apply_icc_;
-    GRK_CPARAMETERS_DEFAULTS.rateControlAlgorithm = rateControlAlgorithm;
-    GRK_CPARAMETERS_DEFAULTS.numThreads = num_threads;
-    GRK_CPARAMETERS_DEFAULTS.deviceId = deviceId;
-
-    GRK_CPARAMETERS_DEFAULTS.duration = duration;
-    // GRK_CPARAMETERS_DEFAULTS.kernelBuildOptions = kernelBuildOptions;
-    GRK_CPARAMETERS_DEFAULTS.repeats = repeats;
-    // GRK_CPARAMETERS_DEFAULTS.writePLT = writePLT;
-    // GRK_CPARAMETERS_DEFAULTS.writeTLM = writeTLM;
-
-    GRK_CPARAMETERS_DEFAULTS.verbose = verbose;
-    // GRK_CPARAMETERS_DEFAULTS.sharedMemoryInterface = sharedMemoryInterface;
+        params.capture_resolution_from_file[i] = capture_resolution_from_file[i];
+        params.capture_resolution[i] = capture_resolution[i];
+        params.display_resolution[i] = display_resolution[i];
+    }
+    params.write_capture_resolution_from_file = write_capture_resolution_from_file;
+    params.write_capture_resolution = write_capture_resolution;
+    params.write_display_resolution = write_display_resolution;*/
+    params.apply_icc_ = apply_icc_;
+    params.rateControlAlgorithm = rateControlAlgorithm;
+    params.numThreads = num_threads;
+    params.deviceId = deviceId;
+
+    params.duration = duration;
+    // params.kernelBuildOptions = kernelBuildOptions;
+    params.repeats = repeats;
+    params.writePLT = writePLT;
+    params.writeTLM = writeTLM;
+
+    params.verbose = verbose;
+    // params.sharedMemoryInterface = sharedMemoryInterface;
+
+    defaults.headerless = headerless;
+    defaults.tiled_chunk = tiled_chunk;
+    defaults.bit_depth = bit_depth > 0 ? bit_depth : 0;
+    defaults.float_error = float_error > 0 ? float_error : 0;
+    defaults.float_rel_error = float_rel_error > 0 ? float_rel_error : 0;
+    defaults.planar = layout != nullptr && strcmp(layout, "CHW") == 0;
+    defaults.stack = layout != nullptr && strcmp(layout, "SHWC") == 0;
+    defaults.spectral_levels = spectral_levels > 0 ? spectral_levels : 0;
+    defaults.target_psnr = target_psnr > 0 ? target_psnr : 0;
+    defaults.target_ssim = target_ssim > 0 ? std::min(target_ssim, 1.0) : 0;
+    defaults.rate_correction = rate_correction;
 
     // Initialize threads and verbose
-    grk_initialize(nullptr, GRK_CPARAMETERS_DEFAULTS.numThreads, GRK_CPARAMETERS_DEFAULTS.verbose);
+    std::lock_guard<std::mutex> lock(GRK_MUTEX);
+    init_grok_pool(params.numThreads, params.verbose);
+    GRK_DEFAULTS = std::make_shared<const grok_defaults>(defaults);
 }
 
 
-int blosc2_grok_encoder(
-    const uint8_t *input,
-    int32_t input_len,
-    uint8_t *output,
-    int32_t output_len,
-    uint8_t meta,
-    blosc2_cparams* cparams,
-    const void* chunk
-) {
-    int size = -1;
+// Output stream of the encoder: the block output buffer, with a hard limit
+struct bounded_sink {
+    uint8_t *buf;
+    size_t cap;
+    size_t pos;
+    size_t len;      // bytes written so far (seeks may move pos back)
+    bool overflow;
+};
 
-    if (!GRK_INITIALIZED) {
-        blosc2_grok_init(0, false);
+
+static size_t sink_write(const uint8_t *buffer, size_t numBytes, void *user_data) {
+    auto *sink = (bounded_sink *)user_data;
+    if (sink->overflow || numBytes > sink->cap - sink->pos) {
+        // Returning a short write makes grok abort the compression
+        sink->overflow = true;
+        return 0;
     }
+    memcpy(sink->buf + sink->pos, buffer, numBytes);
+    sink->pos += numBytes;
+    sink->len = std::max(sink->len, sink->pos);
+    return numBytes;
+}
 
-    // Read blosc2 metadata
-    uint8_t *content;
-    int32_t content_len;
-    BLOSC_ERROR(blosc2_meta_get((blosc2_schunk*)cparams->schunk, "b2nd",
-                                &content, &content_len));
-
-    int8_t ndim;
-    int64_t shape[BLOSC2_MAX_DIM];
-    int32_t chunkshape[BLOSC2_MAX_DIM];
-    int32_t blockshape[BLOSC2_MAX_DIM];
-    char *dtype;
-    int8_t dtype_format;
-    BLOSC_ERROR(
-        b2nd_deserialize_meta(content, content_len, &ndim,
-                              shape, chunkshape, blockshape, &dtype, &dtype_format)
-    );
-    free(content);
-    free(dtype);
-
-    // Determine image dimensions
-    // Ignore leading dimensions if they are 1
-    uint32_t igdim = 0;
-    for (int i = 0; i < ndim; ++i) {
-        if (blockshape[i] == 1) {
-            igdim++;
-        } else {
-            break;
+
+static bool sink_seek(uint64_t offset, void *user_data) {
+    auto *sink = (bounded_sink *)user_data;
+    if (offset > sink->cap) {
+        sink->overflow = true;
+        return false;
+    }
+    sink->pos = (size_t)offset;
+    return true;
+}
+
+
+// Leave only the tile-parts of the raw codestream in `output`, with the main
+// header stored once in the vlmeta of the super-chunk.  Blocks whose header
+// differs from the stored one are kept whole.  Returns the new size.
+static int strip_main_header(uint8_t *output, int size, blosc2_schunk *schunk) {
+    int64_t hlen = get_main_header_len(output, size);
+    if (hlen < 0) {
+        fprintf(stderr, "Cannot find the main header of the codestream\n");
+        return BLOSC2_ERROR_FAILURE;
+    }
+    std::vector<uint8_t> block_header = copy_main_header(output, hlen);
+    shared_header header;
+    BLOSC_ERROR(get_shared_header(schunk, header));
+    if (header == nullptr) {
+        header = std::make_shared<const std::vector<uint8_t>>(block_header);
+        BLOSC_ERROR(set_shared_header(schunk, header));
+    }
+    if (*header != block_header) {
+        return size;
+    }
+    memmove(output, output + hlen, size - hlen);
+    return size - (int)hlen;
+}
+
+
+// How the samples of a block map to the image components.  Interleaved
+// blocks (H, W, C) are a single group of rows holding every component, planar
+// blocks (C, H, W) a group (plane) per component and stacks (S, H, W, C) a
+// group (frame) of C components per frame.  Split samples have two image
+// components per component: the high words first, then the low ones.
+struct block_layout {
+    uint32_t numComps;
+    uint32_t ngroups;
+    bool split;
+
+    uint32_t groups() const { return ngroups; }
+    // components interleaved in a row of a group
+    uint32_t group_comps() const { return numComps / ngroups; }
+
+    // Point `rows` to row `y` (from column `x0`) of the components of group `g`,
+    // as the fill, split and quantize kernels (or their inverses) take them
+    template <typename T>
+    void get_rows(const grk_image *image, uint32_t g, uint32_t x0, uint32_t y, T **rows) const {
+        const uint32_t n = group_comps();
+        for (uint32_t k = 0; k < n; ++k) {
+            const uint32_t compno = g * n + k;
+            auto comp = image->comps + compno;
+            rows[k] = comp->data + (size_t)y * comp->stride + x0;
+            if (split) {
+                auto lo = image->comps + numComps + compno;
+                rows[n + k] = lo->data + (size_t)y * lo->stride + x0;
+            }
         }
     }
-    uint32_t dimX = blockshape[igdim];
-    uint32_t dimY = blockshape[igdim + 1];
-    uint32_t numComps = 1;
-    if ((ndim - igdim) == 3) {
-        // Single image with more than 1 component
-        numComps = blockshape[igdim + 2];
+};
+
+
+// Deinterleave and widen a block of `width` x `height` pixels into the image
+// planes, at (x0, y0); the samples are signed if the image is.  Unless `bits`
+// is null, the OR of every sample is accumulated into it.
+static int fill_image(grk_image *image, const uint8_t *input, uint32_t x0, uint32_t y0,
+                      uint32_t width, uint32_t height, uint32_t typesize, const block_layout &layout,
+                      uint32_t *bits) {
+    const uint32_t numComps = image->numcomps;
+    const uint32_t rowComps = layout.group_comps();
+    const bool sgnd = image->comps[0].sgnd;
+    fill_row_fn fill_row = get_fill_kernel(typesize, rowComps, sgnd);
+    or_row_fn or_row = bits != nullptr ? get_or_kernel(typesize, sgnd) : nullptr;
+    if (fill_row == nullptr) {
+        fprintf(stderr, "Unsupported typesize %d\n", typesize);
+        return BLOSC2_ERROR_INVALID_PARAM;
     }
+    for (uint16_t compno = 0; compno < numComps; ++compno) {
+        if (!image->comps[compno].data) {
+            fprintf(stderr, "Image has null data for component %d\n", compno);
+            return BLOSC2_ERROR_FAILURE;
+        }
+    }
+    // deinterleave and widen a row of every component (of the plane) at once,
+    // taking component stride into account
+    std::vector<int32_t*> rows(numComps);
+    const size_t rowLen = (size_t)width * rowComps * typesize;
+    for (uint32_t g = 0; g < layout.groups(); ++g) {
+        for (uint32_t j = 0; j < height; ++j) {
+            layout.get_rows(image, g, x0, y0 + j, rows.data());
+            fill_row(input, rows.data(), width, rowComps);
+            if (or_row != nullptr) {
+                *bits |= or_row(input, (size_t)width * rowComps);
+            }
+            input += rowLen;
+        }
+    }
+    return 0;
+}
 
-    const uint32_t typesize = ((blosc2_schunk*)cparams->schunk)->typesize;
-    const uint32_t precision = 8 * typesize;
 
-    // initialize compress parameters
-    grk_codec* codec = nullptr;
-    auto *codec_params = (blosc2_grok_params *)cparams->codec_params;
-    grk_cparameters *compressParams;
-    grk_stream_params *streamParams;
+// Precision to code the samples with: the fixed `bit_depth` if any, or else
+// the bit length of `bits`, the OR of every sample (plus the sign bit)
+static uint32_t get_precision(uint32_t bits, uint32_t bit_depth, uint32_t typesize, bool sgnd) {
+    uint32_t prec = bit_depth;
+    if (prec == 0) {
+        prec = 1;
+        while (prec < 32 && (bits >> prec) != 0) {
+            prec++;
+        }
+        if (sgnd && bits != 0) {
+            prec++;
+        }
+    }
+    return std::min(prec, 8 * typesize);
+}
 
-    if (codec_params == nullptr) {
-        compressParams = &GRK_CPARAMETERS_DEFAULTS;
-        streamParams = (grk_stream_params *)malloc(sizeof(grk_stream_params));
-        grk_set_default_stream_params(streamParams);
-    } else {
-        compressParams = &codec_params->compressParams;
-        streamParams = &codec_params->streamParams;
+
+static void set_precision(grk_image *image, uint32_t prec) {
+    for (uint16_t compno = 0; compno < image->numcomps; ++compno) {
+        image->comps[compno].prec = prec;
     }
-    if (meta != 0) {
-        // meta indicates we want rates quality mode with meta/10 cratio
-        compressParams->allocationByRateDistoration = true;
-        compressParams->numlayers = 1;
-        compressParams->layer_rate[0] = meta / 10.0;
-        if (compressParams->cod_format == NULL) {
-            compressParams->cod_format = GRK_FMT_JP2;
-        }
-    }
-
-    std::unique_ptr<uint8_t[]> data;
-    size_t bufLen = (size_t)numComps * ((precision + 7) / 8) * dimX * dimY;
-    data = std::make_unique<uint8_t[]>(bufLen);
-    streamParams->buf = data.get();
-    streamParams->buf_len = bufLen;
-
-    // create image from input
-    auto* components = new grk_image_comp[numComps];
-    for(uint32_t i = 0; i < numComps; ++i) {
-        auto c = components + i;
-        c->w = dimX;
-        c->h = dimY;
-        c->dx = 1;
-        c->dy = 1;
-        c->prec = precision;
-        c->sgnd = false;
-    }
-    grk_image* image;
-    if (numComps == 1) {
-        image = grk_image_new(
-            numComps, components, GRK_CLRSPC_GRAY, true);
+}
 
-    } else {
-        image = grk_image_new(
-            numComps, components, GRK_CLRSPC_SRGB, true);
+
+// Split a block of `width` x `height` pixels of 32-bit samples into the high
+// and low 16-bit words of every component (see split_row), and set the
+// precision of each word from the fixed `bit_depth` of the samples or from
+// the bits they use.  Returns the precision of a high plus a low word.
+static uint32_t split_image(grk_image *image, const uint8_t *input, uint32_t width, uint32_t height,
+                            const block_layout &layout, bool sgnd, uint32_t bit_depth) {
+    const uint32_t numComps = layout.numComps;
+    const uint32_t rowComps = layout.group_comps();
+    or_row_fn or_row = bit_depth == 0 ? get_or_kernel(sizeof(uint32_t), sgnd) : nullptr;
+    std::vector<int32_t*> rows(2 * numComps);
+    const size_t rowLen = (size_t)width * rowComps * sizeof(uint32_t);
+    uint32_t bits = 0;
+    for (uint32_t g = 0; g < layout.groups(); ++g) {
+        for (uint32_t j = 0; j < height; ++j) {
+            layout.get_rows(image, g, 0, j, rows.data());
+            split_row(input, rows.data(), width, rowComps, sgnd);
+            if (or_row != nullptr) {
+                bits |= or_row(input, (size_t)width * rowComps);
+            }
+            input += rowLen;
+        }
+    }
+    // High words of small samples are all 0 (or -1), and cost next to nothing
+    const uint32_t prec = get_precision(bits, bit_depth, sizeof(uint32_t), sgnd);
+    const uint32_t hiprec = prec > 16 ? prec - 16 : 1;
+    // The low words of negative samples use all their bits
+    const uint32_t loprec = sgnd ? 16 : std::min(prec, 16u);
+    for (uint16_t compno = 0; compno < numComps; ++compno) {
+        image->comps[compno].prec = hiprec;
+        image->comps[compno].sgnd = sgnd;
+        image->comps[numComps + compno].prec = loprec;
+        image->comps[numComps + compno].sgnd = false;
     }
+    return hiprec + loprec;
+}
 
-    // fill in component data
-    // see grok.h header for full details of image structure
-    auto *ptr = (uint8_t*)input;
-    uint64_t index = 0;
+
+// Quantized float32 samples are coded with this many bits at most
+#define MAX_FLOAT_PREC 24
+
+// Quantize a block of `width` x `height` float32 pixels into the image planes,
+// with a step that keeps every sample within the error bound (the tighter of
+// `abs_error` and `rel_error` times the range of the block) once decoded as
+// float32.  The quantization is written in `tag`, and the largest quantized
+// value in `qmax`.  Returns false if the samples cannot be quantized: not
+// finite, or needing more bits than a float32 mantissa.
+static bool quantize_image(grk_image *image, const uint8_t *input, uint32_t width, uint32_t height,
+                           const block_layout &layout, double abs_error, double rel_error,
+                           block_tag &tag, uint32_t *qmax) {
+    const uint32_t numComps = layout.numComps;
+    const uint32_t rowComps = layout.group_comps();
+    const size_t rowLen = (size_t)width * rowComps * sizeof(float);
+    float vmin, vmax;
+    if (!minmax_float(input, (size_t)width * height * numComps, &vmin, &vmax)) {
+        return false;
+    }
+    const double range = (double)vmax - vmin;
+    double bound = abs_error > 0 ? abs_error : range * rel_error;
+    if (rel_error > 0) {
+        bound = std::min(bound, range * rel_error);
+    }
+    // Leave room for the rounding of the decoded values to float32
+    const double ulp = std::max(std::fabs((double)vmin), std::fabs((double)vmax)) * std::ldexp(1.0, -23);
+    double step = 2 * (bound - ulp);
+    if (range == 0) {
+        step = 1;
+    }
+    if (step <= 0 || range / step >= (1 << MAX_FLOAT_PREC) - 1) {
+        return false;
+    }
+    tag.flags |= GROK_TAG_FLOAT;
+    tag.offset = vmin;
+    tag.step = step;
+    *qmax = (uint32_t)std::floor(range / step + 0.5);
+
+    std::vector<int32_t*> rows(numComps);
+    for (uint32_t g = 0; g < layout.groups(); ++g) {
+        for (uint32_t j = 0; j < height; ++j) {
+            layout.get_rows(image, g, 0, j, rows.data());
+            quantize_row(input, rows.data(), width, rowComps, tag.offset, tag.step);
+            input += rowLen;
+        }
+    }
+    return true;
+}
+
+
+// Coded samples are never wider than this; wider ones are split (see split_image)
+#define MAX_CODED_PREC 16
+
+// Transforms across the components of an image, to decorrelate them
+enum component_transform {
+    TRANSFORM_SPECTRAL,  // see spectral_forward; the parameter is the number of levels
+    TRANSFORM_TEMPORAL,  // see temporal_forward; the parameter is the number of frames
+};
+
+// Run a transform across the components of the image, or its inverse, a
+// pixel row at a time
+static void transform_image(grk_image *image, component_transform kind, uint32_t param, bool inverse) {
+    const uint32_t numComps = image->numcomps;
+    const uint32_t width = image->comps[0].w;
+    const uint32_t height = image->comps[0].h;
+    std::vector<int32_t*> rows(numComps);
+    for (uint32_t j = 0; j < height; ++j) {
+        for (uint32_t compno = 0; compno < numComps; ++compno) {
+            auto comp = image->comps + compno;
+            rows[compno] = comp->data + (size_t)j * comp->stride;
+        }
+        if (kind == TRANSFORM_SPECTRAL) {
+            (inverse ? spectral_inverse : spectral_forward)(rows.data(), numComps, width, param);
+        } else {
+            (inverse ? temporal_inverse : temporal_forward)(rows.data(), numComps, width, param);
+        }
+    }
+}
+
+
+// Undo the quantization of the samples of an image coded to a rate in HT mode
+static void unscale_image(grk_image *image, double step) {
+    if (step == 1) {
+        return;
+    }
     for (uint16_t compno = 0; compno < image->numcomps; ++compno) {
-        index = compno;
         auto comp = image->comps + compno;
-        auto compWidth = comp->w;
-        auto compHeight = comp->h;
-        auto compData = comp->data;
-        if (!compData) {
-            fprintf(stderr, "Image has null data for component %d\n", compno);
-            goto beach;
+        for (uint32_t j = 0; j < comp->h; ++j) {
+            unscale_row(comp->data + (size_t)j * comp->stride, comp->w, step);
         }
-        // fill in component data, taking component stride into account
-        auto srcData = new int32_t[compWidth * compHeight];
-        memset(srcData, 0, compWidth * compHeight * sizeof(int32_t));
-        for (uint32_t j = 0; j < compHeight; ++j) {
-            for (uint32_t i = 0; i < compWidth; ++i) {
-                memcpy(srcData + j * compWidth + i, &ptr[index * typesize], typesize);
-                index += numComps;
-            }
+    }
+}
+
+
+// Decorrelate the components of a filled image, and set the (signed)
+// precision of every component from the bits the transformed samples use.
+// Returns that precision, or 0 if it is too wide to be coded, and then the
+// image is restored as it was.
+static uint32_t decorrelate_image(grk_image *image, component_transform kind, uint32_t param) {
+    transform_image(image, kind, param, false);
+    or_row_fn or_row = get_or_kernel(sizeof(int32_t), true);
+    uint32_t bits = 0;
+    for (uint16_t compno = 0; compno < image->numcomps; ++compno) {
+        auto comp = image->comps + compno;
+        for (uint32_t j = 0; j < comp->h; ++j) {
+            bits |= or_row((const uint8_t *)(comp->data + (size_t)j * comp->stride), comp->w);
         }
+    }
+    const uint32_t prec = get_precision(bits, 0, sizeof(int32_t), true);
+    if (prec > MAX_CODED_PREC) {
+        transform_image(image, kind, param, true);
+        return 0;
+    }
+    for (uint16_t compno = 0; compno < image->numcomps; ++compno) {
+        image->comps[compno].prec = prec;
+        image->comps[compno].sgnd = true;
+    }
+    return prec;
+}
 
-        auto srcPtr = srcData;
-        for (uint32_t j = 0; j < compHeight; ++j) {
-            memcpy(compData, srcPtr, compWidth * sizeof(int32_t));
-            srcPtr += compWidth;
-            compData += comp->stride;
+
+// grok rates are relative to the size of the image at its precision; make them
+// relative to the size of the stored samples, as blosc2 (and codec_meta) sees it
+static void scale_rates(grk_cparameters &params, uint32_t prec, uint32_t typesize) {
+    if (!params.allocationByRateDistoration || prec == 8 * typesize) {
+        return;
+    }
+    const double scale = (double)prec / (8 * typesize);
+    for (uint16_t i = 0; i < params.numlayers; ++i) {
+        if (params.layer_rate[i] > 1) {
+            params.layer_rate[i] = std::max(1.0, params.layer_rate[i] * scale);
         }
-        delete[] srcData;
     }
+}
+
+
+// Compress `image` straight into `output`.  Returns the codestream size, 0
+// if it does not fit in `output_len` bytes, or a negative error code.
+static int64_t compress_image(grk_image *image, grk_cparameters *compressParams, grk_stream_params *streamParams,
+                              uint8_t *output, size_t output_len) {
+    if (compressParams->allocationByRateDistoration && output_len > 0 &&
+        (compressParams->max_cs_size == 0 || compressParams->max_cs_size > output_len)) {
+        // Let rate control know the budget, so that it never overshoots it
+        compressParams->max_cs_size = output_len;
+    }
+
+    // The codestream is written straight into the output, and the encoder
+    // gives up as soon as it does not fit
+    bounded_sink sink = {output, output_len, 0, 0, false};
+    streamParams->buf = nullptr;
+    streamParams->buf_len = 0;
+    streamParams->write_fn = sink_write;
+    streamParams->seek_fn = sink_seek;
+    streamParams->user_data = &sink;
 
     // initialize compressor
-    codec = grk_compress_init(streamParams, compressParams, image);
+    grk_codec *codec = grk_compress_init(streamParams, compressParams, image);
     if (!codec) {
         fprintf(stderr, "Failed to initialize compressor\n");
-        goto beach;
+        return BLOSC2_ERROR_FAILURE;
     }
 
     // compress
-    size = (int)grk_compress(codec, nullptr);
+    uint64_t size = grk_compress(codec, nullptr);
+    grk_object_unref(codec);
+    if (sink.overflow) {
+        // Uncompressible data
+        return 0;
+    }
     if (size == 0) {
-        size = -1;
         fprintf(stderr, "Failed to compress\n");
-        goto beach;
+        return BLOSC2_ERROR_FAILURE;
     }
-    if (size > output_len) {
-        // Uncompressible data
+    return (int64_t)sink.len;
+}
+
+
+// Decode a codestream just coded and measure its quality against `orig`
+static bool measure_codestream(const uint8_t *cs, size_t cs_len, const image_planes &orig, uint32_t prec,
+                               image_quality &quality) {
+    grk_decompress_parameters decompressParams;
+    grk_decompress_set_default_params(&decompressParams);
+    grk_stream_params streamParams;
+    grk_set_default_stream_params(&streamParams);
+    streamParams.buf = (uint8_t *)cs;
+    streamParams.buf_len = cs_len;
+    grk_codec *codec = grk_decompress_init(&streamParams, &decompressParams.core);
+    if (!codec) {
+        return false;
+    }
+    grk_header_info headerInfo;
+    memset(&headerInfo, 0, sizeof(headerInfo));
+    bool ok = grk_decompress_read_header(codec, &headerInfo) && grk_decompress(codec, nullptr);
+    grk_image *image = ok ? grk_decompress_get_composited_image(codec) : nullptr;
+    ok = image != nullptr && measure_quality(orig, image, prec, quality);
+    grk_object_unref(codec);
+    return ok;
+}
+
+
+// Blocks coded to a target quality take this many passes at most
+#define MAX_QUALITY_PASSES 12
+// The search stops once the rates that do and do not reach the target are this close
+#define QUALITY_RATE_TOLERANCE 1.05
+// grok rates the search starts with and never goes beyond
+#define QUALITY_START_RATE 10.0
+#define QUALITY_MAX_RATE 1000.0
+// Factor between the rates tried until the target is bracketed: a tight one
+// after a warm start, growing to the wide one of a cold start
+#define QUALITY_WARM_STEP 1.1
+#define QUALITY_COLD_STEP 2.0
+
+// Code `image` at the highest rate whose decoded image still reaches the
+// target PSNR and SSIM (those not 0).  The search starts from the rate of the
+// previous block of the super-chunk in this thread, with a tight bracket, as
+// neighbouring blocks usually need similar rates; otherwise it starts from a
+// wide one.  Images that cannot reach the target at any rate are coded with
+// the rest of the parameters as they are.  Returns the codestream size, 0 if
+// it does not fit in `output_len` bytes, or a negative error code.
+static int64_t compress_to_quality(grk_image *image, const grk_cparameters &compressParams,
+                                   grk_stream_params *streamParams, uint8_t *output, size_t output_len,
+                                   uint32_t prec, double target_psnr, double target_ssim,
+                                   const blosc2_schunk *schunk) {
+    image_planes orig;
+    copy_planes(image, orig);
+
+    std::vector<uint8_t> trial(output_len);
+    std::vector<uint8_t> best;
+    image_quality best_quality = {0, 0};
+    double lo = 0;      // highest rate known to reach the target
+    double hi = 0;      // lowest rate known to miss it
+    double over = 0;    // highest rate known not to fit in the output (not measured)
+    double rate = get_start_rate(schunk);
+    double step = QUALITY_WARM_STEP;
+    if (rate == 0) {
+        rate = QUALITY_START_RATE;
+        step = QUALITY_COLD_STEP;
+    }
+    uint32_t passes = 0;
+    while (passes < MAX_QUALITY_PASSES) {
+        grk_cparameters params = compressParams;
+        params.allocationByRateDistoration = true;
+        params.numlayers = 1;
+        params.layer_rate[0] = rate;
+        int64_t size = compress_image(image, &params, streamParams, trial.data(), trial.size());
+        if (size < 0) {
+            return size;
+        }
+        passes++;
+        image_quality quality;
+        if (size == 0) {
+            // Too big for the block, so aim higher
+            over = rate;
+        } else if (!measure_codestream(trial.data(), (size_t)size, orig, prec, quality)) {
+            fprintf(stderr, "Failed to decode a block to measure its quality\n");
+            return BLOSC2_ERROR_FAILURE;
+        } else if (quality.psnr >= target_psnr && quality.ssim >= target_ssim) {
+            lo = rate;
+            best.assign(trial.begin(), trial.begin() + size);
+            best_quality = quality;
+        } else {
+            hi = rate;
+        }
+
+        // Rates up to `low` either reach the target or do not fit
+        const double low = std::max(lo, over);
+        if (hi == 0) {
+            if (low >= QUALITY_MAX_RATE) {
+                break;
+            }
+            rate = std::min(low * step, QUALITY_MAX_RATE);
+        } else if (low == 0) {
+            if (hi <= 1) {
+                break;
+            }
+            rate = std::max(hi / step, 1.0);
+        } else {
+            // Nothing in between if the rates that fit all miss the target
+            if (hi <= over || hi / low <= QUALITY_RATE_TOLERANCE) {
+                break;
+            }
+            rate = std::sqrt(low * hi);
+        }
+        step = std::min(2 * step, QUALITY_COLD_STEP);
+    }
+
+    if (best.empty()) {
+        // Best effort: no rate control beyond the one asked for
+        grk_cparameters params = compressParams;
+        int64_t size = compress_image(image, &params, streamParams, output, output_len);
+        if (size > 0) {
+            passes++;
+            if (measure_codestream(output, (size_t)size, orig, prec, best_quality)) {
+                record_quality(best_quality, passes);
+            }
+        }
+        return size;
+    }
+    set_start_rate(schunk, lo);
+    record_quality(best_quality, passes);
+    memcpy(output, best.data(), best.size());
+    return (int64_t)best.size();
+}
+
+
+// Rate corrections never go beyond this factor either way
+#define MAX_RATE_CORRECTION 2.0
+
+// Code `image` to the rates of `compressParams`, corrected by the factor the
+// previous block coded with the same settings in this thread needed to land on
+// its last rate.  grok allocates the rate of every block from scratch, and the
+// error of that allocation (headers included) is usually similar for
+// neighbouring blocks, so the codestream ends up closer to the rate asked for.
+static int64_t compress_to_rate(grk_image *image, grk_cparameters &compressParams, grk_stream_params *streamParams,
+                                uint8_t *output, size_t output_len, uint32_t prec) {
+    // The last layer sets the size of the codestream; nothing to correct if it is lossless
+    const uint16_t numlayers = compressParams.numlayers;
+    const double target = compressParams.allocationByRateDistoration && numlayers > 0 ?
+                          compressParams.layer_rate[numlayers - 1] : 0;
+    if (target <= 1) {
+        return compress_image(image, &compressParams, streamParams, output, output_len);
+    }
+    const rate_settings settings = {target, image->comps[0].w, image->comps[0].h, image->numcomps, prec};
+    const double correction = get_rate_correction(settings);
+    for (uint16_t i = 0; i < numlayers; ++i) {
+        if (compressParams.layer_rate[i] > 1) {
+            compressParams.layer_rate[i] = std::max(1.0, compressParams.layer_rate[i] * correction);
+        }
+    }
+    int64_t size = compress_image(image, &compressParams, streamParams, output, output_len);
+    if (size > 0) {
+        // Achieved rate, relative to the size of the image at its precision as grok rates are
+        const double raw = (double)image->comps[0].w * image->comps[0].h * image->numcomps * prec / 8;
+        const double next = correction * target / (raw / (double)size);
+        set_rate_correction(settings, std::clamp(next, 1 / MAX_RATE_CORRECTION, MAX_RATE_CORRECTION));
+    }
+    return size;
+}
+
+
+// Code-block style of HTJ2K (GrkMode.HT)
+#define HT_CBLK_STYLE 0x40
+// HT blocks coded to a rate take this many passes at most (plus a last resort one)
+#define MAX_HT_PASSES 8
+// The search stops once the steps that do and do not fit are this close
+#define HT_STEP_TOLERANCE 1.1
+
+// HTJ2K has no rate allocation (code-blocks are coded whole), so code `image`
+// in at most `budget` bytes by quantizing its samples to round(v / step) first,
+// with about the smallest step that fits.  A step costs about log2(step) bits
+// per sample, which gives the next step to try from the size of the last pass,
+// until there are steps that fit and that do not, and then they are bisected.
+// The search starts from the step of the previous block of the super-chunk in
+// this thread, if any.  The step used is returned in `step`.
+static int64_t compress_ht_to_rate(grk_image *image, grk_cparameters compressParams, grk_stream_params *streamParams,
+                                   uint8_t *output, size_t output_len, size_t budget, uint32_t prec, double &step,
+                                   const blosc2_schunk *schunk) {
+    compressParams.allocationByRateDistoration = false;
+    compressParams.numlayers = 1;
+    compressParams.layer_rate[0] = 0;
+    image_planes orig;
+    copy_planes(image, orig);
+    const double nsamples = (double)orig.data.size();
+    // Every sample is quantized to 0 or 1 beyond this
+    const double max_step = std::ldexp(1.0, (int)prec);
+
+    std::vector<uint8_t> trial(output_len);
+    std::vector<uint8_t> best;
+    double fits = 0;    // smallest step known to fit in the budget
+    double big = 0;     // largest step known not to
+    auto code_pass = [&](double s) -> int64_t {
+        scale_planes(orig, image, s);
+        grk_cparameters params = compressParams;
+        int64_t size = compress_image(image, &params, streamParams, trial.data(), trial.size());
+        if (size > 0 && (size_t)size <= budget) {
+            fits = s;
+            best.assign(trial.begin(), trial.begin() + size);
+        } else if (size >= 0) {
+            big = std::max(big, s);
+        }
+        return size;
+    };
+
+    double s = std::max(get_start_step(schunk), 1.0);
+    for (uint32_t pass = 0; pass < MAX_HT_PASSES; ++pass) {
+        int64_t size = code_pass(s);
+        if (size < 0) {
+            return size;
+        }
+        if (fits == 1 || big >= max_step) {
+            break;
+        }
+        if (fits > 0 && big > 0) {
+            if (fits / big <= HT_STEP_TOLERANCE) {
+                break;
+            }
+            s = std::sqrt(fits * big);
+        } else if (fits > 0) {
+            const double next = s * std::exp2(8 * ((double)size - (double)budget) / nsamples);
+            s = std::max(std::min(next, s / HT_STEP_TOLERANCE), 1.0);
+        } else {
+            // Too big for the output buffer: no size to start from
+            const double next = size > 0 ? s * std::exp2(8 * ((double)size - (double)budget) / nsamples) : 4 * s;
+            s = std::min(std::max(next, s * HT_STEP_TOLERANCE), max_step);
+        }
+    }
+    if (best.empty() && big < max_step) {
+        int64_t size = code_pass(max_step);
+        if (size < 0) {
+            return size;
+        }
+    }
+    if (best.empty()) {
+        // Not even the headers fit: let blosc2 store the block as is
+        return 0;
+    }
+    set_start_step(schunk, fits);
+    step = fits;
+    memcpy(output, best.data(), best.size());
+    return (int64_t)best.size();
+}
+
+
+// Tag of a block that repeats a single pixel of `pixelsize` bytes.  Returns
+// its length, or 0 if the block is not constant or the tag would not fit.
+static int32_t get_const_tag(const uint8_t *input, int32_t input_len, int32_t output_len, uint32_t pixelsize,
+                             block_tag &tag) {
+    if (pixelsize > GROK_TAG_MAX_FILL || !is_periodic(input, input_len, pixelsize)) {
         return 0;
     }
-    memcpy(output, streamParams->buf, size);
+    tag = {};
+    tag.flags = GROK_TAG_CONST;
+    tag.fill_len = (uint16_t)pixelsize;
+    memcpy(tag.fill, input, pixelsize);
+    const int32_t taglen = (int32_t)get_tag_size(tag);
+    return taglen < input_len && taglen <= output_len ? taglen : 0;
+}
 
-beach:
-    // cleanup
-    delete[] components;
-    grk_object_unref(codec);
+
+// Code the whole chunk as a single codestream with a tile per block, and
+// split it into the tile-parts of every tile
+static int encode_tiled_chunk(tiled_chunk *entry, const uint8_t *chunk, const encoder_ctx *ctx,
+                              grk_cparameters compressParams, grk_stream_params streamParams,
+                              uint32_t bit_depth, size_t budget, blosc2_schunk *schunk) {
+    compressParams.cod_format = GRK_FMT_J2K;
+    compressParams.tile_size_on = true;
+    compressParams.tx0 = 0;
+    compressParams.ty0 = 0;
+    compressParams.t_width = ctx->width;
+    compressParams.t_height = ctx->height;
+    // Packet lengths let a block read skip straight to the packets it needs.
+    // No TLM is needed: blosc2 already indexes the blocks (hence the tiles).
+    compressParams.writePLT = true;
+    compressParams.writeTLM = false;
+
+    grk_image *image = get_arena_image(ctx->numComps, ctx->tiles_x * ctx->width, ctx->tiles_y * ctx->height,
+                                       ctx->precision, ctx->sgnd);
+    if (image == nullptr) {
+        fprintf(stderr, "Failed to allocate the image\n");
+        return BLOSC2_ERROR_MEMORY_ALLOC;
+    }
+    const size_t blocksize = (size_t)ctx->width * ctx->height * ctx->numComps * ctx->typesize;
+    int rc = 0;
+    uint32_t bits = 0;
+    uint32_t pending = 0;
+    for (uint32_t nblock = 0; nblock < ctx->nblocks && rc == 0; ++nblock) {
+        const uint8_t *block = chunk + nblock * blocksize;
+        entry->hashes[nblock] = hash_block(block, blocksize);
+        // blosc2 stores a block of a single repeated byte as a run, and the
+        // encoder stores constant blocks as a tag, both without reaching here
+        block_tag fill_tag;
+        const bool skipped = is_periodic(block, blocksize, 1) ||
+                             get_const_tag(block, (int32_t)blocksize, (int32_t)(budget / ctx->nblocks),
+                                           ctx->typesize * ctx->numComps, fill_tag) > 0;
+        pending += skipped ? 0 : 1;
+        rc = fill_image(image, block, (nblock % ctx->tiles_x) * ctx->width, (nblock / ctx->tiles_x) * ctx->height,
+                        ctx->width, ctx->height, ctx->typesize, {ctx->numComps, 1, false},
+                        bit_depth == 0 ? &bits : nullptr);
+    }
+    if (rc < 0) {
+        grk_object_unref(&image->obj);
+        return rc;
+    }
+    entry->pending = pending;
+    // A single precision for the whole chunk, as all the tiles share the main header
+    const uint32_t prec = get_precision(bits, bit_depth, ctx->typesize, ctx->sgnd);
+    set_precision(image, prec);
+    scale_rates(compressParams, prec, ctx->typesize);
+
+    std::vector<uint8_t> cs(budget);
+    int64_t size = compress_image(image, &compressParams, &streamParams, cs.data(), cs.size());
     grk_object_unref(&image->obj);
+    if (size <= 0) {
+        return (int)size;
+    }
+    BLOSC_ERROR(split_tile_parts(cs.data(), size, ctx->nblocks, entry->header, entry->tiles));
+
+    // Blocks only keep their tile-parts if the main header is the one in vlmeta
+    shared_header header;
+    BLOSC_ERROR(get_shared_header(schunk, header));
+    if (header == nullptr) {
+        header = std::make_shared<const std::vector<uint8_t>>(entry->header);
+        BLOSC_ERROR(set_shared_header(schunk, header));
+    }
+    entry->shared = *header == entry->header;
+    return 1;
+}
+
+
+// Whether the buffer still holds the chunk that `entry` was coded from.  All
+// the blocks are checked, as a new chunk may share some of them with the old
+// one; hashing the chunk is cheap next to coding it.
+static bool same_chunk(const tiled_chunk *entry, const uint8_t *chunk, size_t blocksize) {
+    for (size_t nblock = 0; nblock < entry->hashes.size(); ++nblock) {
+        if (entry->hashes[nblock] != hash_block(chunk + nblock * blocksize, blocksize)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Encode a block in tiled chunk mode.  `done` is false if the block cannot
+// be located in the chunk, and it has to be coded on its own.
+static int encode_tiled_block(const uint8_t *input, int32_t input_len, uint8_t *output, int32_t output_len,
+                              const uint8_t *chunk, const encoder_ctx *ctx,
+                              const grk_cparameters &compressParams, const grk_stream_params &streamParams,
+                              uint32_t bit_depth, blosc2_schunk *schunk, bool &done) {
+    done = false;
+    const size_t blocksize = (size_t)ctx->width * ctx->height * ctx->numComps * ctx->typesize;
+    // Filters or split streams would hand a copy of the block to the codec
+    if (chunk == nullptr || input < chunk || (size_t)input_len != blocksize ||
+        (size_t)(input - chunk) % blocksize != 0 || (size_t)(input - chunk) / blocksize >= ctx->nblocks) {
+        return 0;
+    }
+    done = true;
+    const uint32_t nblock = (uint32_t)((input - chunk) / blocksize);
+
+    auto entry = get_tiled_chunk(chunk, ctx->nblocks);
+    if (entry == nullptr) {
+        done = false;
+        return 0;
+    }
+    int size;
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (!entry->encoded || !same_chunk(entry.get(), chunk, blocksize)) {
+            // First block of the chunk, or the buffer holds a new chunk
+            entry->rc = encode_tiled_chunk(entry.get(), chunk, ctx, compressParams, streamParams,
+                                           bit_depth, (size_t)output_len * ctx->nblocks, schunk);
+            entry->encoded = true;
+        }
+        if (entry->rc <= 0) {
+            size = entry->rc;
+        } else {
+            // Self-contained block if the main header is not the shared one
+            const auto &tile = entry->tiles[nblock];
+            size_t hlen = entry->shared ? 0 : entry->header.size();
+            if (hlen + tile.size() > (size_t)output_len) {
+                size = 0;
+            } else {
+                memcpy(output, entry->header.data(), hlen);
+                memcpy(output + hlen, tile.data(), tile.size());
+                size = (int)(hlen + tile.size());
+            }
+        }
+    }
+    if (size <= 0) {
+        entry->failed = true;
+    }
+    release_tiled_chunk(chunk, entry);
+    return size;
+}
+
+
+// Record in the vlmeta of `schunk` the layout of its blocks ("CHW" or
+// "SHWC"), so that readers of single blocks (see blosc2_grok_decode_block)
+// know it.  The 'grok_layout' entry is a msgpack string.
+static int set_layout_meta(blosc2_schunk *schunk, const char *layout) {
+    static std::mutex layout_mutex;
+    if (blosc2_vlmeta_exists(schunk, GROK_LAYOUT_VLMETA) >= 0) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(layout_mutex);
+    // Another block may have stored it in the meantime
+    if (blosc2_vlmeta_exists(schunk, GROK_LAYOUT_VLMETA) >= 0) {
+        return 0;
+    }
+    // A msgpack fixstr
+    std::vector<uint8_t> content = {(uint8_t)(0xa0 | strlen(layout))};
+    content.insert(content.end(), layout, layout + strlen(layout));
+    BLOSC_ERROR(blosc2_vlmeta_add(schunk, GROK_LAYOUT_VLMETA, content.data(), (int32_t)content.size(), nullptr));
+    return 0;
+}
+
+
+int blosc2_grok_encoder(
+    const uint8_t *input,
+    int32_t input_len,
+    uint8_t *output,
+    int32_t output_len,
+    uint8_t meta,
+    blosc2_cparams* cparams,
+    const void* chunk
+) {
+    ensure_initialized();
+
+    // Image geometry is derived once per super-chunk
+    auto *schunk = (blosc2_schunk*)cparams->schunk;
+    std::shared_ptr<const encoder_ctx> ctx;
+    BLOSC_ERROR(get_encoder_ctx(schunk, ctx));
+    const uint32_t typesize = ctx->typesize;
+    const uint32_t precision = ctx->precision;
+
+    // initialize compress parameters
+    // Each call works on its own copy, so that concurrent blocks (or arrays with
+    // different codec_meta) never see each other's changes
+    auto *codec_params = (blosc2_grok_params *)cparams->codec_params;
+    grk_cparameters compressParams;
+    grk_stream_params streamParams;
+
+    auto defaults = get_defaults();
     if (codec_params == nullptr) {
-        free(streamParams);
+        compressParams = defaults->compressParams;
+        grk_set_default_stream_params(&streamParams);
+    } else {
+        compressParams = codec_params->compressParams;
+        streamParams = codec_params->streamParams;
+    }
+    // Planar blocks map every plane to a component, with no deinterleaving,
+    // and stacks the components of every frame to a group of components.
+    // Blocks with 4 non-unit dimensions can only be stacks.
+    const bool planar = defaults->planar && ctx->planar_comps > 0;
+    const bool stack = (defaults->stack || ctx->width == 0) && ctx->stack_frames > 0;
+    uint32_t dimX = ctx->width;
+    uint32_t dimY = ctx->height;
+    uint32_t numComps = ctx->numComps;
+    uint32_t groups = 1;
+    if (planar) {
+        dimX = ctx->planar_width;
+        dimY = ctx->planar_height;
+        numComps = ctx->planar_comps;
+        groups = numComps;
+        BLOSC_ERROR(set_layout_meta(schunk, "CHW"));
+    } else if (stack) {
+        dimX = ctx->stack_width;
+        dimY = ctx->stack_height;
+        numComps = ctx->stack_frames * ctx->stack_comps;
+        groups = ctx->stack_frames;
+        BLOSC_ERROR(set_layout_meta(schunk, "SHWC"));
+    }
+
+    // Constant blocks (masks, detector gaps, background) need no codec at all,
+    // only the pixel they repeat
+    block_tag fill_tag;
+    const int32_t filllen = get_const_tag(input, input_len, output_len, typesize * numComps / groups, fill_tag);
+    if (filllen > 0) {
+        write_tag(fill_tag, output);
+        return filllen;
+    }
+
+    const bool headerless = defaults->headerless;
+    if (headerless) {
+        // Only raw codestreams can be split into main header and tile-parts
+        compressParams.cod_format = GRK_FMT_J2K;
+    }
+    if (meta != 0) {
+        // meta indicates we want rates quality mode with meta/10 cratio
+        compressParams.allocationByRateDistoration = true;
+        compressParams.numlayers = 1;
+        compressParams.layer_rate[0] = meta / 10.0;
+        if (compressParams.cod_format == GRK_FMT_UNK) {
+            compressParams.cod_format = GRK_FMT_JP2;
+        }
+    }
+
+    // Float32 samples are quantized within the error bound, if any, and other
+    // 32-bit samples (too wide for JPEG 2000) are split in 16-bit words
+    const bool quantize = ctx->floating && (defaults->float_error > 0 || defaults->float_rel_error > 0);
+    const bool split = typesize == 4 && !quantize;
+    if (quantize) {
+        // The error bound only holds if the quantized samples come back exactly,
+        // so they are always coded losslessly (this also rules out HT rates)
+        compressParams.allocationByRateDistoration = false;
+        compressParams.allocationByQuality = false;
+        compressParams.numlayers = 1;
+        compressParams.layer_rate[0] = 0;
+        compressParams.irreversible = false;
+    }
+    // Components are decorrelated with as many levels as they have room for,
+    // and the frames of stacks are predicted from the previous one instead
+    uint32_t levels = 0;
+    while (!split && !stack && levels < defaults->spectral_levels && (1u << levels) < numComps) {
+        levels++;
+    }
+    const bool predict = stack && !split && groups > 1;
+    // Target quality is measured on the samples, so it is only for blocks whose
+    // components are the samples themselves, and codec_meta takes precedence
+    const bool targeted = (defaults->target_psnr > 0 || defaults->target_ssim > 0) && meta == 0 &&
+                          !quantize && !split && levels == 0 && !predict;
+
+    // HTJ2K has no rate allocation, so HT blocks reach their rate by scaling
+    // their samples down instead (not for split ones, whose low words are noise)
+    const uint16_t nlayers = compressParams.numlayers;
+    double ht_rate = 0;
+    if ((compressParams.cblk_sty & HT_CBLK_STYLE) && compressParams.allocationByRateDistoration && nlayers > 0 &&
+        !split && !targeted) {
+        ht_rate = compressParams.layer_rate[nlayers - 1] > 1 ? compressParams.layer_rate[nlayers - 1] : 0;
+    }
+
+    // Blocks with a tag are always coded on their own
+    const block_layout layout = {numComps, groups, split};
+    if (defaults->tiled_chunk && ctx->tileable && ctx->nblocks > 1 && !quantize && !split && !planar &&
+        !stack && levels == 0 && !targeted && ht_rate == 0) {
+        // The whole chunk is a single codestream, so give all the cores to grok
+        auto pool = acquire_grok_pool(cparams->nthreads, 1);
+        bool done;
+        int size = encode_tiled_block(input, input_len, output, output_len, (const uint8_t *)chunk, ctx.get(),
+                                      compressParams, streamParams, defaults->bit_depth, schunk, done);
+        if (done) {
+            return size;
+        }
+    }
+
+    // Keep the grok pool (sized for this chunk in auto mode) while coding
+    auto pool = acquire_grok_pool(cparams->nthreads, ctx->nblocks);
+
+    // The image comes from the arena of this thread
+    grk_image* image = split ? get_arena_image(2 * numComps, dimX, dimY, 16, ctx->sgnd)
+                             : get_arena_image(numComps, dimX, dimY, precision, ctx->sgnd);
+    if (image == nullptr) {
+        fprintf(stderr, "Failed to allocate the image\n");
+        return BLOSC2_ERROR_MEMORY_ALLOC;
+    }
+
+    // fill in component data, finding the bit depth of the block on the way
+    // see grok.h header for full details of image structure
+    uint32_t bit_depth = defaults->bit_depth;
+    uint32_t bits = 0;
+    block_tag tag = {};
+    int size = 0;
+    uint32_t prec = 0;
+    if (planar) {
+        tag.flags |= GROK_TAG_PLANAR;
+    }
+    if (stack) {
+        tag.flags |= GROK_TAG_STACK;
+        tag.frames = (uint16_t)groups;
+    }
+    if (split) {
+        tag.flags |= GROK_TAG_SPLIT32;
+        prec = split_image(image, input, dimX, dimY, layout, ctx->sgnd, bit_depth);
+    } else if (quantize) {
+        if (!quantize_image(image, input, dimX, dimY, layout, defaults->float_error, defaults->float_rel_error,
+                            tag, &bits)) {
+            // Let blosc2 store the block as is
+            grk_object_unref(&image->obj);
+            return 0;
+        }
+        bit_depth = 0;
+    } else {
+        size = fill_image(image, input, 0, 0, dimX, dimY, typesize, layout, bit_depth == 0 ? &bits : nullptr);
+    }
+    // Blocks whose details (or residuals) would be too wide are coded as they are
+    if (size == 0 && levels > 0) {
+        prec = decorrelate_image(image, TRANSFORM_SPECTRAL, levels);
+        if (prec > 0) {
+            tag.flags |= GROK_TAG_SPECTRAL;
+            tag.levels = (uint8_t)levels;
+            tag.sgnd = ctx->sgnd;
+        }
+    } else if (size == 0 && predict) {
+        prec = decorrelate_image(image, TRANSFORM_TEMPORAL, groups);
+        if (prec > 0) {
+            tag.flags |= GROK_TAG_TEMPORAL;
+            tag.sgnd = ctx->sgnd;
+        }
+    }
+    if (tag.flags & (GROK_TAG_SPECTRAL | GROK_TAG_TEMPORAL)) {
+        // The components are no longer RGB
+        compressParams.mct = 0;
+    }
+    if (ht_rate > 0) {
+        // The step is only known once coded
+        tag.flags |= GROK_TAG_SCALED;
+        tag.scale = 1;
+    }
+    // The codestream follows the tag, if the block needs one
+    const int32_t taglen = tag.flags != 0 ? (int32_t)get_tag_size(tag) : 0;
+    if (size == 0 && output_len > taglen) {
+        if (prec == 0) {
+            prec = get_precision(bits, bit_depth, typesize, ctx->sgnd);
+            set_precision(image, prec);
+        }
+        if (ht_rate > 0) {
+            // The rate is relative to the size of the block, as blosc2 sees it
+            const size_t budget = (size_t)std::max(input_len / ht_rate - taglen, 1.0);
+            size = (int)compress_ht_to_rate(image, compressParams, &streamParams, output + taglen,
+                                            output_len - taglen, budget, prec, tag.scale, schunk);
+        } else if (targeted) {
+            size = (int)compress_to_quality(image, compressParams, &streamParams, output + taglen,
+                                            output_len - taglen, prec, defaults->target_psnr, defaults->target_ssim,
+                                            schunk);
+        } else {
+            scale_rates(compressParams, prec, typesize);
+            if (defaults->rate_correction) {
+                size = (int)compress_to_rate(image, compressParams, &streamParams, output + taglen,
+                                             output_len - taglen, prec);
+            } else {
+                size = (int)compress_image(image, &compressParams, &streamParams, output + taglen,
+                                           output_len - taglen);
+            }
+        }
+        if (size > 0 && headerless) {
+            size = strip_main_header(output + taglen, size, schunk);
+        }
+        if (size > 0 && taglen > 0) {
+            write_tag(tag, output);
+            size += taglen;
+        }
     }
 
+    // cleanup
+    grk_object_unref(&image->obj);
+
     return size;
 }
 
+uint16_t blosc2_grok_max_layers() {
+    return GRK_MAX_LAYERS;
+}
+
+
+// Number of quality layers to decode the blocks of `schunk` with, from its
+// 'grok_layers' vlmeta entry (a msgpack positive integer).  0 means all of them.
+static uint16_t get_decode_layers(blosc2_schunk *schunk) {
+    if (schunk == nullptr || blosc2_vlmeta_exists(schunk, GROK_LAYERS_VLMETA) < 0) {
+        return 0;
+    }
+    uint8_t *content;
+    int32_t content_len;
+    if (blosc2_vlmeta_get(schunk, GROK_LAYERS_VLMETA, &content, &content_len) < 0) {
+        return 0;
+    }
+    int32_t layers = -1;
+    if (content_len == 1 && content[0] <= 0x7f) {
+        layers = content[0];
+    } else if (content_len == 2 && content[0] == 0xcc) {
+        layers = content[1];
+    } else if (content_len == 3 && content[0] == 0xcd) {
+        layers = (content[1] << 8) | content[2];
+    }
+    free(content);
+    if (layers < 0 || layers > GRK_MAX_LAYERS) {
+        fprintf(stderr, "Invalid number of layers in the '%s' vlmeta, decoding all of them\n", GROK_LAYERS_VLMETA);
+        return 0;
+    }
+    return (uint16_t)layers;
+}
+
+// Input stream of the decoder for headerless blocks: the shared main header
+// followed by the tile-parts of the block
+struct split_source {
+    const uint8_t *seg[2];
+    size_t len[2];
+    size_t pos;
+};
+
+
+static size_t source_read(uint8_t *buffer, size_t numBytes, void *user_data) {
+    auto *src = (split_source *)user_data;
+    size_t nread = 0;
+    while (nread < numBytes && src->pos < src->len[0] + src->len[1]) {
+        int k = src->pos < src->len[0] ? 0 : 1;
+        size_t offset = k == 0 ? src->pos : src->pos - src->len[0];
+        size_t n = std::min(numBytes - nread, src->len[k] - offset);
+        memcpy(buffer + nread, src->seg[k] + offset, n);
+        nread += n;
+        src->pos += n;
+    }
+    return nread;
+}
+
+
+static bool source_seek(uint64_t offset, void *user_data) {
+    auto *src = (split_source *)user_data;
+    if (offset > src->len[0] + src->len[1]) {
+        return false;
+    }
+    src->pos = (size_t)offset;
+    return true;
+}
+
+
 int beach_decoder(grk_codec * codec, int rc) {
     // cleanup
     grk_object_unref(codec);
     return rc;
 }
 
-// Decompress a block
-int blosc2_grok_decoder(const uint8_t *input, int32_t input_len, uint8_t *output, int32_t output_len,
-                        uint8_t meta, blosc2_dparams *dparams, const void *chunk) {
-    if (!GRK_INITIALIZED) {
-        blosc2_grok_init(0, false);
-    }
-
+// Decode a codestream (`header` is the shared main header of a headerless
+// block, or null) into `output`, interleaved, with samples of `typesize`
+// bytes (0 to derive it from the precision, or the tag) and undoing the
+// transforms described by `tag`, with a row every `stride` bytes
+// (0 for packed rows).  Returns the number of bytes spanned in `output`, with
+// the size of the decoded image in `width` and `height`, or a negative error
+// code.
+static int64_t decode_codestream(const uint8_t *input, int32_t input_len, const shared_header &header,
+                                 const blosc2_grok_dparams &opts, const block_tag &tag, uint32_t typesize,
+                                 uint8_t *output, int64_t output_len, int64_t stride,
+                                 uint32_t *width, uint32_t *height) {
     // initialize decompress parameters
     grk_decompress_parameters decompressParams;
     grk_decompress_set_default_params(&decompressParams);
     decompressParams.compressionLevel = GRK_DECOMPRESS_COMPRESSION_LEVEL_DEFAULT;
     decompressParams.verbose_ = true;
+    decompressParams.core.reduce = opts.reduce;
+    // grok stops reading the packets of a tile after this layer
+    decompressParams.core.layers_to_decompress_ = opts.layers;
 
     grk_image *image = nullptr;
     grk_codec *codec = nullptr;
@@ -358,8 +1366,17 @@ int blosc2_grok_decoder(const uint8_t *input, int32_t input_len, uint8_t *output
     // initialize decompressor
     grk_stream_params streamParams;
     grk_set_default_stream_params(&streamParams);
-    streamParams.buf = (uint8_t *)input;
-    streamParams.buf_len = input_len;
+    split_source source;
+    if (header != nullptr) {
+        source = {{header->data(), input}, {header->size(), (size_t)input_len}, 0};
+        streamParams.read_fn = source_read;
+        streamParams.seek_fn = source_seek;
+        streamParams.user_data = &source;
+        streamParams.stream_len = header->size() + input_len;
+    } else {
+        streamParams.buf = (uint8_t *)input;
+        streamParams.buf_len = input_len;
+    }
     codec = grk_decompress_init(&streamParams, &decompressParams.core);
     if (!codec) {
         fprintf(stderr, "Failed to set up decompressor\n");
@@ -373,51 +1390,518 @@ int blosc2_grok_decoder(const uint8_t *input, int32_t input_len, uint8_t *output
         fprintf(stderr, "Failed to read the header\n");
         return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
     }
+    if (opts.reduce >= headerInfo.numresolutions) {
+        fprintf(stderr, "Cannot reduce %d levels an image with %d resolutions\n",
+                opts.reduce, headerInfo.numresolutions);
+        return beach_decoder(codec, BLOSC2_ERROR_INVALID_PARAM);
+    }
 
-    // retrieve image that will store uncompressed image data
-    image = grk_decompress_get_composited_image(codec);
-    if (!image) {
-        fprintf(stderr, "Failed to retrieve image \n");
-        return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+    // A block of a tiled chunk only holds the tile-parts of its own tile
+    int32_t tile = -1;
+    if (headerInfo.t_grid_width * headerInfo.t_grid_height > 1) {
+        int64_t offset = header != nullptr ? 0 : get_main_header_len(input, input_len);
+        if (offset >= 0) {
+            tile = get_single_tile(input, input_len, offset);
+        }
     }
 
-    // decompress all tiles
-    if (!grk_decompress(codec, nullptr)){
-        fprintf(stderr, "Error when decompressing image\n");
-        return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+    if (opts.x1 > opts.x0 && opts.y1 > opts.y0) {
+        // Region of interest: grok only decodes the code-blocks and precincts
+        // overlapping the window, which is given in canvas coordinates
+        image = grk_decompress_get_composited_image(codec);
+        if (!image) {
+            fprintf(stderr, "Failed to retrieve image \n");
+            return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+        }
+        uint32_t ox = image->x0;
+        uint32_t oy = image->y0;
+        uint32_t ex = image->x1;
+        uint32_t ey = image->y1;
+        if (tile >= 0) {
+            // the window falls inside the tile, so no other tile is needed
+            uint32_t tx = headerInfo.tx0 + (tile % headerInfo.t_grid_width) * headerInfo.t_width;
+            uint32_t ty = headerInfo.ty0 + (tile / headerInfo.t_grid_width) * headerInfo.t_height;
+            ox = std::max(tx, image->x0);
+            oy = std::max(ty, image->y0);
+            ex = std::min(tx + headerInfo.t_width, image->x1);
+            ey = std::min(ty + headerInfo.t_height, image->y1);
+        }
+        if (ox + opts.x1 > ex || oy + opts.y1 > ey) {
+            fprintf(stderr, "Decode window out of the block\n");
+            return beach_decoder(codec, BLOSC2_ERROR_INVALID_PARAM);
+        }
+        if (!grk_decompress_set_window(codec, ox + opts.x0, oy + opts.y0, ox + opts.x1, oy + opts.y1)) {
+            fprintf(stderr, "Invalid decode window\n");
+            return beach_decoder(codec, BLOSC2_ERROR_INVALID_PARAM);
+        }
+        if (!grk_decompress(codec, nullptr)){
+            fprintf(stderr, "Error when decompressing image\n");
+            return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+        }
+        // the image now has the geometry of the (reduced) window
+        image = grk_decompress_get_composited_image(codec);
+        if (!image) {
+            fprintf(stderr, "Failed to retrieve image \n");
+            return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+        }
+    } else if (tile >= 0) {
+        // decompress just that tile
+        if (!grk_decompress_tile(codec, (uint16_t)tile)) {
+            fprintf(stderr, "Error when decompressing tile %d\n", tile);
+            return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+        }
+        image = grk_decompress_get_tile_image(codec, (uint16_t)tile);
+        if (!image) {
+            fprintf(stderr, "Failed to retrieve image \n");
+            return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+        }
+    } else {
+        // retrieve image that will store uncompressed image data
+        image = grk_decompress_get_composited_image(codec);
+        if (!image) {
+            fprintf(stderr, "Failed to retrieve image \n");
+            return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+        }
+
+        // decompress all tiles
+        if (!grk_decompress(codec, nullptr)){
+            fprintf(stderr, "Error when decompressing image\n");
+            return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+        }
     }
 
     // see grok.h header for full details of image structure
-    memset(output, 0, output_len);
-    auto copyPtr = output;
-    uint64_t index = 0;
-    for (uint16_t compno = 0; compno < image->numcomps; ++compno) {
-        index = compno;
+    const uint32_t numComps = image->numcomps;
+    const uint32_t compWidth = image->comps[0].w;
+    const uint32_t compHeight = image->comps[0].h;
+    // Samples may be coded with fewer bits than they are stored with
+    const bool dequantize = (tag.flags & GROK_TAG_FLOAT) != 0;
+    // Split samples come as a high and a low word component each
+    const bool join = (tag.flags & GROK_TAG_SPLIT32) != 0;
+    // Decorrelated components are signed details, and wider than the samples
+    const bool spectral = (tag.flags & GROK_TAG_SPECTRAL) != 0;
+    // ... and so are the residuals of predicted frames
+    const bool temporal = (tag.flags & GROK_TAG_TEMPORAL) != 0;
+    const uint32_t sampleComps = join ? numComps / 2 : numComps;
+    uint32_t groups = 1;
+    if (tag.flags & GROK_TAG_PLANAR) {
+        groups = sampleComps;
+    } else if (tag.flags & GROK_TAG_STACK) {
+        groups = tag.frames;
+    }
+    if (groups == 0 || sampleComps % groups != 0) {
+        fprintf(stderr, "Invalid number of frames in a stack\n");
+        return beach_decoder(codec, BLOSC2_ERROR_INVALID_HEADER);
+    }
+    const block_layout layout = {sampleComps, groups, join};
+    // Without a super-chunk, the samples fill the whole output block (their
+    // precision may be narrower than the type they are stored with)
+    uint32_t itemsize = typesize;
+    const size_t nsamples = (size_t)compWidth * compHeight * sampleComps;
+    if (itemsize == 0 && nsamples > 0 && (size_t)output_len % nsamples == 0 &&
+        (size_t)output_len / nsamples <= sizeof(uint64_t)) {
+        itemsize = (uint32_t)((size_t)output_len / nsamples);
+    }
+    if (itemsize == 0) {
+        itemsize = (image->comps[0].prec + 7) / 8;
+    }
+    if (dequantize || join) {
+        itemsize = sizeof(uint32_t);
+    }
+    // Signed samples are sign-extended by grok, and saturate to the signed range when stored
+    const bool coded_sgnd = image->comps[0].sgnd;
+    const bool sgnd = spectral || temporal ? tag.sgnd : coded_sgnd;
+    if (join && numComps % 2 != 0) {
+        fprintf(stderr, "Split samples need an even number of components\n");
+        return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+    }
+    std::vector<const int32_t*> rows(numComps);
+    for (uint16_t compno = 0; compno < numComps; ++compno) {
         auto comp = image->comps + compno;
-        auto compWidth = comp->w;
-        auto compHeight = comp->h;
-        auto compData = comp->data;
-        if (!compData) {
+        if (!comp->data) {
             fprintf(stderr, "Image has null data for component %d\n", compno);
             return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
         }
-        // copy data, taking component stride into account
-        int itemsize =  (comp->prec / 8);
-        // int itemsize =  ((comp->prec + 7) / 8);
+        if (comp->w != compWidth || comp->h != compHeight || (comp->prec > 8 * itemsize && !spectral && !temporal) ||
+            (comp->sgnd != coded_sgnd && !join)) {
+            fprintf(stderr, "Components with different geometry are not supported\n");
+            return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+        }
+    }
+    // Planar blocks (and stacks) are written a plane (frame) after the other, with the same stride
+    const uint32_t rowComps = layout.group_comps();
+    const bool custom = dequantize || join;
+    store_row_fn store_row = custom ? nullptr : get_store_kernel(itemsize, rowComps, sgnd);
+    const size_t rowLen = (size_t)compWidth * rowComps * itemsize;
+    if (stride == 0) {
+        stride = (int64_t)rowLen;
+    }
+    const size_t nrows = (size_t)compHeight * layout.groups();
+    const size_t covered = nrows == 0 ? 0 : (size_t)stride * (nrows - 1) + rowLen;
+    if ((store_row == nullptr && !custom) || (size_t)stride < rowLen || covered > (size_t)output_len) {
+        fprintf(stderr, "Decoded image does not fit in the output block\n");
+        return beach_decoder(codec, BLOSC2_ERROR_FAILURE);
+    }
+
+    if (tag.flags & GROK_TAG_SCALED) {
+        unscale_image(image, tag.scale);
+    }
+    if (spectral) {
+        transform_image(image, TRANSFORM_SPECTRAL, tag.levels, true);
+    } else if (temporal) {
+        transform_image(image, TRANSFORM_TEMPORAL, groups, true);
+    }
+
+    // narrow and interleave a row of every component (of the plane) at once,
+    // taking component stride into account
+    auto copyPtr = output;
+    for (uint32_t g = 0; g < layout.groups(); ++g) {
         for (uint32_t j = 0; j < compHeight; ++j) {
-            auto compData = comp->data + comp->stride * j;
-            for (uint32_t i = 0; i < compWidth; ++i) {
-                memcpy(&copyPtr[index * itemsize], compData, itemsize);
-                compData += 1;
-                index += image->numcomps;
+            layout.get_rows(image, g, 0, j, rows.data());
+            if (dequantize) {
+                dequantize_row(rows.data(), copyPtr, compWidth, rowComps, tag.offset, tag.step);
+            } else if (join) {
+                join_row(rows.data(), copyPtr, compWidth, rowComps, sgnd);
+            } else {
+                store_row(rows.data(), copyPtr, compWidth, rowComps);
             }
+            copyPtr += stride;
         }
     }
+    *width = compWidth;
+    *height = compHeight;
 
     grk_object_unref(codec);
+    return (int64_t)covered;
+}
+
+
+static inline bool is_headerless(const uint8_t *input, int32_t input_len) {
+    return input_len >= 2 && ((input[0] << 8) | input[1]) == J2K_SOT;
+}
+
+
+// Decompress a block
+int blosc2_grok_decoder(const uint8_t *input, int32_t input_len, uint8_t *output, int32_t output_len,
+                        uint8_t meta, blosc2_dparams *dparams, const void *chunk) {
+    ensure_initialized();
+
+    // Tagged blocks: the codestream follows the tag
+    block_tag tag;
+    const int taglen = read_tag(input, input_len, tag);
+    if (taglen < 0) {
+        return taglen;
+    }
+    if (tag.flags & GROK_TAG_CONST) {
+        // Constant block: no codestream at all
+        fill_pattern(output, output_len, tag.fill, tag.fill_len);
+        return output_len;
+    }
+    const uint8_t *cs = input + taglen;
+    const int32_t cs_len = input_len - taglen;
+
+    shared_header header;
+    if (is_headerless(cs, cs_len)) {
+        // Headerless block: the main header is shared by the whole super-chunk
+        int rc = get_shared_header((blosc2_schunk *)dparams->schunk, header);
+        if (rc < 0 || header == nullptr) {
+            fprintf(stderr, "Cannot find the main header of a headerless block\n");
+            return BLOSC2_ERROR_FAILURE;
+        }
+    }
+
+    blosc2_grok_dparams opts = {0};
+    opts.layers = get_decode_layers((blosc2_schunk *)dparams->schunk);
+
+    const bool cached = decode_cache_enabled();
+    cache_key key;
+    cache_source source = {input, input_len, nullptr, 0};
+    if (cached) {
+        key = {hash_block(input, input_len), input_len, output_len, opts.layers};
+        if (header != nullptr) {
+            key.hash ^= hash_block(header->data(), header->size()) * 0x9E3779B97F4A7C15ULL;
+            source.header = header->data();
+            source.header_len = header->size();
+        }
+        if (cache_get(key, source, output, output_len)) {
+            return output_len;
+        }
+    }
+
+    // Keep the grok pool while decoding
+    auto pool = share_grok_pool();
+
+    uint32_t width, height;
+    auto *schunk = (blosc2_schunk *)dparams->schunk;
+    const uint32_t typesize = schunk != nullptr ? (uint32_t)schunk->typesize : 0;
+    int64_t covered = decode_codestream(cs, cs_len, header, opts, tag, typesize, output, output_len, 0,
+                                        &width, &height);
+    if (covered < 0) {
+        return (int)covered;
+    }
+    // only the bytes not covered by the decoded components need zeroing
+    memset(output + covered, 0, output_len - covered);
+    if (cached) {
+        cache_put(key, source, output, output_len);
+    }
     return output_len;
 }
 
+
+// Keep one pixel out of 2^reduce in each direction of the [x0, x1) x [y0, y1)
+// window of a block, for blocks that are not grok codestreams.  The block has
+// `nplanes` planes (one for interleaved blocks), which are written one after
+// the other, as grok blocks do.  The pixels kept are the same as those of a
+// reduced grok window.
+static int64_t subsample_block(const uint8_t *block, uint32_t bwidth, uint32_t bheight, uint32_t pixelsize,
+                               uint32_t nplanes, const blosc2_grok_dparams &opts,
+                               uint8_t *dest, int64_t dest_len, int64_t stride, uint32_t *width, uint32_t *height) {
+    uint32_t x0 = 0, y0 = 0, x1 = bwidth, y1 = bheight;
+    if (opts.x1 > opts.x0 && opts.y1 > opts.y0) {
+        if (opts.x1 > bwidth || opts.y1 > bheight) {
+            fprintf(stderr, "Invalid decode window\n");
+            return BLOSC2_ERROR_INVALID_PARAM;
+        }
+        x0 = opts.x0;
+        y0 = opts.y0;
+        x1 = opts.x1;
+        y1 = opts.y1;
+    }
+    const uint32_t step = 1u << opts.reduce;
+    const uint32_t rx0 = (x0 + step - 1) >> opts.reduce;
+    const uint32_t ry0 = (y0 + step - 1) >> opts.reduce;
+    const uint32_t rwidth = ((x1 + step - 1) >> opts.reduce) - rx0;
+    const uint32_t rheight = ((y1 + step - 1) >> opts.reduce) - ry0;
+    const size_t rowLen = (size_t)rwidth * pixelsize;
+    if (stride == 0) {
+        stride = (int64_t)rowLen;
+    }
+    const size_t nrows = (size_t)rheight * nplanes;
+    const size_t covered = nrows == 0 ? 0 : (size_t)stride * (nrows - 1) + rowLen;
+    if ((size_t)stride < rowLen || covered > (size_t)dest_len) {
+        fprintf(stderr, "Decoded image does not fit in the output buffer\n");
+        return BLOSC2_ERROR_WRITE_BUFFER;
+    }
+    const size_t planeLen = (size_t)bwidth * bheight * pixelsize;
+    for (uint32_t p = 0; p < nplanes; ++p) {
+        for (uint32_t j = 0; j < rheight; ++j) {
+            const uint8_t *row = block + p * planeLen + (size_t)((ry0 + j) << opts.reduce) * bwidth * pixelsize;
+            uint8_t *ptr = dest + ((size_t)p * rheight + j) * stride;
+            for (uint32_t i = 0; i < rwidth; ++i) {
+                memcpy(ptr, row + (size_t)((rx0 + i) << opts.reduce) * pixelsize, pixelsize);
+                ptr += pixelsize;
+            }
+        }
+    }
+    *width = rwidth;
+    *height = rheight;
+    return (int64_t)covered;
+}
+
+
+// Whether every block of a chunk is a single stream, as the grok codec leaves
+// them: no special or memcpyed chunk, no filters and unsplit streams
+// (bit 4 of the flags means that streams are not split).
+static bool has_plain_streams(const uint8_t *chunk) {
+    const uint8_t flags = chunk[BLOSC2_CHUNK_FLAGS];
+    const uint8_t blosc2_flags = chunk[BLOSC2_CHUNK_BLOSC2_FLAGS];
+    const uint32_t typesize = chunk[BLOSC2_CHUNK_TYPESIZE];
+    bool plain = !(flags & BLOSC_MEMCPYED) && ((blosc2_flags >> 4) & BLOSC2_SPECIAL_MASK) == 0 &&
+                 !(blosc2_flags & (BLOSC2_INSTR_CODEC | BLOSC2_USEDICT)) && ((flags & 0x10) || typesize == 1) &&
+                 chunk[BLOSC2_CHUNK_BLOSC2_FLAGS2] == 0;
+    for (int i = 0; i < BLOSC2_MAX_FILTERS; ++i) {
+        plain &= chunk[BLOSC2_CHUNK_FILTER_CODES + i] == BLOSC_NOFILTER;
+    }
+    return plain;
+}
+
+
+// Locate the stream of block `nblock` (of `bsize` bytes) in a chunk with
+// plain streams.  Returns the length of the whole stream (its size included)
+// or a negative error code.  `stream` points to the codestream, or is null
+// for runs and blocks stored as is.
+static int32_t locate_stream(const uint8_t *chunk, int32_t cbytes, int32_t nblock, int32_t bsize,
+                             const uint8_t **stream, int32_t *stream_len) {
+    *stream = nullptr;
+    *stream_len = 0;
+    int32_t bstart, csize;
+    memcpy(&bstart, chunk + BLOSC_EXTENDED_HEADER_LENGTH + nblock * sizeof(int32_t), sizeof(int32_t));
+    if (bstart <= 0 || bstart + (int32_t)sizeof(int32_t) > cbytes) {
+        return BLOSC2_ERROR_READ_BUFFER;
+    }
+    memcpy(&csize, chunk + bstart, sizeof(int32_t));
+    // A run (size <= 0) or a block stored as is (size == bsize)
+    int32_t len = (int32_t)sizeof(int32_t) + std::max(csize, 0);
+    if (bstart + len > cbytes) {
+        return BLOSC2_ERROR_READ_BUFFER;
+    }
+    if (csize > 0 && csize < bsize) {
+        *stream = chunk + bstart + sizeof(int32_t);
+        *stream_len = csize;
+    }
+    return len;
+}
+
+
+int64_t blosc2_grok_decode_block(const uint8_t *chunk, int32_t chunk_len, int32_t nblock,
+                                 uint32_t bwidth, uint32_t bheight, uint32_t numComps,
+                                 const uint8_t *header, int32_t header_len, const blosc2_grok_dparams *dparams,
+                                 uint8_t *dest, int64_t dest_len, int64_t dest_stride,
+                                 uint32_t *width, uint32_t *height) {
+    ensure_initialized();
+
+    int32_t nbytes, cbytes, blocksize;
+    BLOSC_ERROR(blosc2_cbuffer_sizes(chunk, &nbytes, &cbytes, &blocksize));
+    if (cbytes > chunk_len || blocksize <= 0 || nblock < 0 || (int64_t)nblock * blocksize >= nbytes) {
+        fprintf(stderr, "Invalid chunk or block number\n");
+        return BLOSC2_ERROR_INVALID_PARAM;
+    }
+    const uint32_t typesize = chunk[BLOSC2_CHUNK_TYPESIZE];
+    const int32_t bsize = std::min(blocksize, nbytes - nblock * blocksize);
+    if ((size_t)bwidth * bheight * numComps * typesize != (size_t)bsize) {
+        fprintf(stderr, "Block geometry does not match the block size\n");
+        return BLOSC2_ERROR_INVALID_PARAM;
+    }
+
+    // Locate the stream of the block.  Only unfiltered, unsplit streams can be
+    // grok codestreams; anything else (special chunks, runs, memcpyed blocks...)
+    // is decompressed by blosc2 and subsampled, and so are constant blocks.
+    const uint8_t *stream = nullptr;
+    int32_t stream_len = 0;
+    if (has_plain_streams(chunk) && locate_stream(chunk, cbytes, nblock, bsize, &stream, &stream_len) < 0) {
+        stream = nullptr;
+    }
+
+    block_tag tag;
+    int taglen = 0;
+    if (stream != nullptr) {
+        taglen = read_tag(stream, stream_len, tag);
+        if (taglen < 0) {
+            return taglen;
+        }
+    }
+
+    if (stream == nullptr || (tag.flags & GROK_TAG_CONST)) {
+        std::vector<uint8_t> block(bsize);
+        if (stream == nullptr) {
+            blosc2_context *dctx = blosc2_create_dctx(BLOSC2_DPARAMS_DEFAULTS);
+            int rc = blosc2_getitem_ctx(dctx, chunk, chunk_len, (int)(nblock * (blocksize / typesize)),
+                                        (int)(bsize / typesize), block.data(), bsize);
+            blosc2_free_ctx(dctx);
+            if (rc < 0) {
+                return rc;
+            }
+        } else {
+            fill_pattern(block.data(), bsize, tag.fill, tag.fill_len);
+        }
+        const uint32_t planes = std::max(dparams->planes, 1u);
+        if (numComps % planes != 0) {
+            fprintf(stderr, "Invalid number of planes\n");
+            return BLOSC2_ERROR_INVALID_PARAM;
+        }
+        return subsample_block(block.data(), bwidth, bheight, numComps / planes * typesize, planes, *dparams,
+                               dest, dest_len, dest_stride, width, height);
+    }
+
+    stream += taglen;
+    stream_len -= taglen;
+
+    shared_header shared;
+    if (is_headerless(stream, stream_len)) {
+        if (header == nullptr || header_len <= 0) {
+            fprintf(stderr, "Cannot find the main header of a headerless block\n");
+            return BLOSC2_ERROR_INVALID_PARAM;
+        }
+        shared = std::make_shared<const std::vector<uint8_t>>(header, header + header_len);
+    }
+    auto pool = share_grok_pool();
+    return decode_codestream(stream, stream_len, shared, *dparams, tag, typesize, dest, dest_len, dest_stride,
+                             width, height);
+}
+
+int32_t blosc2_grok_truncate_chunk(const uint8_t *chunk, int32_t chunk_len,
+                                   const uint8_t *header, int32_t header_len, uint16_t layers, double rate,
+                                   uint8_t *dest, int32_t dest_len) {
+    int32_t nbytes, cbytes, blocksize;
+    BLOSC_ERROR(blosc2_cbuffer_sizes(chunk, &nbytes, &cbytes, &blocksize));
+    if (cbytes > chunk_len || dest_len < cbytes) {
+        fprintf(stderr, "Invalid chunk or output buffer\n");
+        return BLOSC2_ERROR_INVALID_PARAM;
+    }
+    if (nbytes == 0 || blocksize <= 0 || !has_plain_streams(chunk)) {
+        // Nothing coded by grok here (special values, memcpyed...)
+        memcpy(dest, chunk, cbytes);
+        return cbytes;
+    }
+
+    // Same chunk header and block starts, followed by the new streams
+    const int32_t nblocks = (nbytes + blocksize - 1) / blocksize;
+    int32_t pos = BLOSC_EXTENDED_HEADER_LENGTH + nblocks * (int32_t)sizeof(int32_t);
+    if (pos > cbytes) {
+        return BLOSC2_ERROR_READ_BUFFER;
+    }
+    memcpy(dest, chunk, pos);
+    std::vector<uint8_t> truncated;
+    for (int32_t nblock = 0; nblock < nblocks; ++nblock) {
+        const int32_t bsize = std::min(blocksize, nbytes - nblock * blocksize);
+        const uint8_t *stream;
+        int32_t stream_len, csize;
+        int32_t len = locate_stream(chunk, cbytes, nblock, bsize, &stream, &stream_len);
+        if (len < 0) {
+            return len;
+        }
+        if (stream == nullptr) {
+            // Runs and blocks stored as is are kept
+            int32_t bstart;
+            memcpy(&bstart, chunk + BLOSC_EXTENDED_HEADER_LENGTH + nblock * sizeof(int32_t), sizeof(int32_t));
+            stream = chunk + bstart + sizeof(int32_t);
+            stream_len = len - (int32_t)sizeof(int32_t);
+            memcpy(&csize, chunk + bstart, sizeof(int32_t));
+        } else {
+            // The tag of tagged blocks is kept as is
+            block_tag tag;
+            int taglen = read_tag(stream, stream_len, tag);
+            if (taglen < 0) {
+                return taglen;
+            }
+            if (tag.flags & GROK_TAG_CONST) {
+                // Constant blocks have no layers to drop
+                truncated.assign(stream, stream + stream_len);
+            } else {
+                size_t budget = rate > 0 ? (size_t)(bsize / rate) : 0;
+                if (budget > 0) {
+                    budget = std::max(budget, (size_t)taglen + 1) - taglen;
+                }
+                int rc = truncate_block(stream + taglen, stream_len - taglen, header,
+                                        header_len > 0 ? header_len : 0, layers, budget, truncated);
+                if (rc < 0) {
+                    fprintf(stderr, "Cannot truncate block %d\n", nblock);
+                    return rc;
+                }
+                truncated.insert(truncated.begin(), stream, stream + taglen);
+            }
+            stream = truncated.data();
+            stream_len = (int32_t)truncated.size();
+            csize = stream_len;
+        }
+        if (pos + (int32_t)sizeof(int32_t) + stream_len > dest_len) {
+            return BLOSC2_ERROR_WRITE_BUFFER;
+        }
+        memcpy(dest + BLOSC_EXTENDED_HEADER_LENGTH + nblock * sizeof(int32_t), &pos, sizeof(int32_t));
+        memcpy(dest + pos, &csize, sizeof(int32_t));
+        memcpy(dest + pos + sizeof(int32_t), stream, stream_len);
+        pos += (int32_t)sizeof(int32_t) + stream_len;
+    }
+    memcpy(dest + BLOSC2_CHUNK_CBYTES, &pos, sizeof(int32_t));
+    return pos;
+}
+
+
 void blosc2_grok_destroy() {
+    clear_encoder_ctxs();
+    clear_decode_cache();
+    clear_shared_headers();
+    clear_tiled_chunks();
     grk_deinitialize();
+    reset_grok_pool();
 }
@@ -26,9 +26,126 @@ typedef struct {
     grk_stream_params streamParams;
 } blosc2_grok_params;
 
+// How the size of the grok thread pool is chosen (see pool.h)
+enum {
+    BLOSC2_GROK_SCHED_FIXED = 0,  // the one given to blosc2_grok_init or in 'num_threads'
+    BLOSC2_GROK_SCHED_AUTO = 1,   // derived from the blosc2 threads and blocks per chunk
+};
+
 void blosc2_grok_init(uint32_t nthreads, bool verbose);
 void blosc2_grok_destroy();
 
+// Set the scheduler mode.  `ncores` is the total core budget for auto mode
+// (0 means all the cores of the machine).
+void blosc2_grok_set_sched_mode(int mode, uint32_t ncores);
+
+// Reuse counters of the per-thread arenas (see arena.h), for all threads
+typedef struct {
+    uint64_t image_hits;
+    uint64_t image_misses;
+} blosc2_grok_arena_stats;
+
+// Options for decoding a single block with blosc2_grok_decode_block
+typedef struct {
+    uint8_t reduce;     // number of resolution levels to discard (the image is 2^reduce smaller)
+    // Region of the block to decode, [x0, x1) x [y0, y1) in pixels of the full
+    // resolution block.  x1 = y1 = 0 decodes the whole block.  With `reduce`,
+    // the region decoded is [ceil(x0 / 2^reduce), ceil(x1 / 2^reduce)) (same for y).
+    uint32_t x0;
+    uint32_t y0;
+    uint32_t x1;
+    uint32_t y1;
+    // Number of quality layers to decode (0 for all of them)
+    uint16_t layers;
+    // Blocks stored as is hold this many planes (C, H, W) or frames (S, H, W, C)
+    // one after the other, or 0 for a single interleaved image (grok blocks
+    // tell it themselves)
+    uint32_t planes;
+} blosc2_grok_dparams;
+
+// vlmeta entry with the number of quality layers that the blosc2 decoder uses
+// for the blocks of an array (a msgpack positive integer; all if missing or 0)
+#define GROK_LAYERS_VLMETA "grok_layers"
+
+// Largest number of quality layers of a block (that of grok)
+uint16_t blosc2_grok_max_layers();
+
+// vlmeta entry that the encoder adds to arrays with planar (C, H, W) blocks
+// or stacks of frames (S, H, W, C) (a msgpack string, "CHW" or "SHWC");
+// blocks are interleaved (H, W, C) if missing
+#define GROK_LAYOUT_VLMETA "grok_layout"
+
+// Decode block `nblock` of a (compressed) chunk, with a geometry of `bwidth`
+// x `bheight` pixels of `numComps` components.  `header` is the main header
+// shared by headerless blocks (the 'grok_header' vlmeta entry), or NULL.  The
+// image is written interleaved in `dest`, one row every `dest_stride` bytes
+// (0 for packed rows), so that it can land straight into a bigger array.
+// Planar blocks (and stacks) are written a plane (frame) after the other, with
+// the same stride; `numComps` counts the components of all of them.
+// The dimensions of the image are returned in `width` and `height`.  Returns
+// the number of bytes spanned in `dest` or a negative error code.
+int64_t blosc2_grok_decode_block(const uint8_t *chunk, int32_t chunk_len, int32_t nblock,
+                                 uint32_t bwidth, uint32_t bheight, uint32_t numComps,
+                                 const uint8_t *header, int32_t header_len, const blosc2_grok_dparams *dparams,
+                                 uint8_t *dest, int64_t dest_len, int64_t dest_stride,
+                                 uint32_t *width, uint32_t *height);
+
+// Rewrite a (compressed) chunk keeping only the first `layers` quality layers
+// of its grok blocks (0 for all of them), or, with a non-zero `rate`, the most
+// layers that keep each block within its size divided by `rate`.  Packets are
+// just dropped, so nothing is decoded or coded again; blocks need PLT markers
+// (writePLT) and the LRCP progression order.  `header` is the main header
+// shared by headerless blocks (the 'grok_header' vlmeta entry), or NULL.  The
+// new chunk is written in `dest`, which must be at least as large as the
+// chunk.  Returns its size or a negative error code.
+int32_t blosc2_grok_truncate_chunk(const uint8_t *chunk, int32_t chunk_len,
+                                   const uint8_t *header, int32_t header_len, uint16_t layers, double rate,
+                                   uint8_t *dest, int32_t dest_len);
+
+void blosc2_grok_get_arena_stats(blosc2_grok_arena_stats *stats);
+void blosc2_grok_reset_arena_stats();
+
+// Counters of the blocks coded to a target PSNR or SSIM, with the quality
+// they achieved (see quality.h)
+typedef struct {
+    uint64_t blocks;
+    uint64_t passes;        // encode and decode passes spent on them
+    uint64_t psnr_blocks;   // blocks with a finite PSNR (not coded losslessly)
+    double sum_psnr;        // of the blocks with a finite PSNR
+    double min_psnr;
+    double sum_ssim;
+    double min_ssim;
+} blosc2_grok_quality_stats;
+
+void blosc2_grok_get_quality_stats(blosc2_grok_quality_stats *stats);
+void blosc2_grok_reset_quality_stats();
+
+// Counters of the cache of decoded blocks (see cache.h), and its current size
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t nbytes;
+    uint64_t nblocks;
+} blosc2_grok_cache_stats;
+
+// Enable the cache of decoded blocks, using up to `nbytes` of memory (0, the
+// default, disables it and drops the cached blocks)
+void blosc2_grok_set_decode_cache(int64_t nbytes);
+void blosc2_grok_get_cache_stats(blosc2_grok_cache_stats *stats);
+void blosc2_grok_reset_cache_stats();
+
+// Counters of the chunks coded in tiled chunk mode (see tiled.h)
+typedef struct {
+    uint64_t chunks;        // coded as a single codestream
+    uint64_t unplaced;      // blocks coded on their own, with too many chunks in flight
+    uint64_t evictions;     // failed chunks dropped to make room
+    uint64_t in_flight;     // chunks with blocks not emitted yet
+} blosc2_grok_tiled_stats;
+
+void blosc2_grok_get_tiled_stats(blosc2_grok_tiled_stats *stats);
+void blosc2_grok_reset_tiled_stats();
+
 void blosc2_grok_set_default_params(const int64_t *tile_size, const int64_t *tile_offset,
                                     int numlayers, char *quality_mode, const double *quality_layers,
                                     int numgbits, char *progression,
@@ -42,7 +159,10 @@ void blosc2_grok_set_default_params(const int64_t *tile_size, const int64_t *til
                                     bool apply_icc_,
                                     GRK_RATE_CONTROL_ALGORITHM rateControlAlgorithm, int num_threads, int deviceId,
                                     int duration, int repeats,
-                                    bool verbose);
+                                    bool verbose, bool headerless, bool writePLT, bool writeTLM,
+                                    bool tiled_chunk, int bit_depth, double float_error, double float_rel_error,
+                                    char *layout, int spectral_levels, double target_psnr, double target_ssim,
+                                    bool rate_correction);
 
 
 #ifdef __cplusplus
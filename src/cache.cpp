@@ -0,0 +1,191 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "blosc2_grok.h"
+#include "cache.h"
+
+#define NSHARDS 16
+
+struct cache_entry {
+    cache_key key;
+    std::vector<uint8_t> source;    // the block and the shared main header it was decoded from
+    std::vector<uint8_t> data;
+
+    int64_t size() const {
+        return (int64_t)(source.size() + data.size());
+    }
+};
+
+struct key_hasher {
+    size_t operator()(const cache_key &key) const {
+        return (size_t)key.hash;
+    }
+};
+
+struct cache_shard {
+    std::mutex mutex;
+    std::list<cache_entry> lru;     // most recently used first
+    std::unordered_map<cache_key, std::list<cache_entry>::iterator, key_hasher> index;
+    int64_t bytes = 0;
+};
+
+static cache_shard shards[NSHARDS];
+static std::atomic<int64_t> max_bytes{0};
+// Bytes cached in every shard; the budget is global, so a single block may use all of it
+static std::atomic<int64_t> total_bytes{0};
+
+static std::atomic<uint64_t> hits{0};
+static std::atomic<uint64_t> misses{0};
+static std::atomic<uint64_t> evictions{0};
+
+
+static inline int get_shard(const cache_key &key) {
+    // The low bits pick the hash bucket, so use the high ones here
+    return (int)((key.hash >> 56) % NSHARDS);
+}
+
+
+// Evict from the tail of the shard (locked by the caller) until the whole cache
+// holds at most `limit` bytes, keeping the `keep` most recently used blocks
+static void shrink_shard(cache_shard &shard, int64_t limit, size_t keep) {
+    while (total_bytes.load(std::memory_order_relaxed) > limit && shard.lru.size() > keep) {
+        cache_entry &entry = shard.lru.back();
+        shard.bytes -= entry.size();
+        total_bytes.fetch_sub(entry.size(), std::memory_order_relaxed);
+        shard.index.erase(entry.key);
+        shard.lru.pop_back();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+
+// Evict from every shard but `skip`, one lock at a time, until the cache holds
+// at most `limit` bytes.  Eviction is LRU within a shard only.
+static void shrink_cache(int skip, int64_t limit) {
+    for (int i = 0; i < NSHARDS && total_bytes.load(std::memory_order_relaxed) > limit; i++) {
+        if (i == skip) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        shrink_shard(shards[i], limit, 0);
+    }
+}
+
+
+// Whether `entry` was decoded from `src`: the key is only a hash of it
+static bool same_source(const cache_entry &entry, const cache_source &src) {
+    return entry.source.size() == (size_t)src.input_len + src.header_len &&
+           memcmp(entry.source.data(), src.input, src.input_len) == 0 &&
+           (src.header_len == 0 || memcmp(entry.source.data() + src.input_len, src.header, src.header_len) == 0);
+}
+
+
+bool decode_cache_enabled() {
+    return max_bytes.load(std::memory_order_relaxed) > 0;
+}
+
+
+bool cache_get(const cache_key &key, const cache_source &src, uint8_t *output, int32_t output_len) {
+    cache_shard &shard = shards[get_shard(key)];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end() && it->second->data.size() == (size_t)output_len &&
+            same_source(*it->second, src)) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            memcpy(output, it->second->data.data(), output_len);
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+
+void cache_put(const cache_key &key, const cache_source &src, const uint8_t *output, int32_t output_len) {
+    const int64_t limit = max_bytes.load(std::memory_order_relaxed);
+    if (output_len + src.input_len + (int64_t)src.header_len > limit) {
+        return;
+    }
+    // Copy out of the lock
+    cache_entry entry = {key, std::vector<uint8_t>(src.input, src.input + src.input_len),
+                         std::vector<uint8_t>(output, output + output_len)};
+    entry.source.insert(entry.source.end(), src.header, src.header + src.header_len);
+    const int64_t size = entry.size();
+    const int ishard = get_shard(key);
+    cache_shard &shard = shards[ishard];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            if (same_source(*it->second, src)) {
+                // Another thread decoded the same block in the meantime
+                return;
+            }
+            // Another block with the same hash: keep the latest one
+            shard.bytes -= it->second->size();
+            total_bytes.fetch_sub(it->second->size(), std::memory_order_relaxed);
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+        shard.lru.push_front(std::move(entry));
+        shard.index[key] = shard.lru.begin();
+        shard.bytes += size;
+        total_bytes.fetch_add(size, std::memory_order_relaxed);
+        // Make room in this shard first, but never evict the new block
+        shrink_shard(shard, limit, 1);
+    }
+    // Then in the others, without holding two locks at once
+    shrink_cache(ishard, limit);
+}
+
+
+void clear_decode_cache() {
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.lru.clear();
+        shard.index.clear();
+        total_bytes.fetch_sub(shard.bytes, std::memory_order_relaxed);
+        shard.bytes = 0;
+    }
+}
+
+
+void blosc2_grok_set_decode_cache(int64_t nbytes) {
+    max_bytes = nbytes > 0 ? nbytes : 0;
+    shrink_cache(-1, max_bytes);
+}
+
+
+void blosc2_grok_get_cache_stats(blosc2_grok_cache_stats *stats) {
+    stats->hits = hits.load(std::memory_order_relaxed);
+    stats->misses = misses.load(std::memory_order_relaxed);
+    stats->evictions = evictions.load(std::memory_order_relaxed);
+    stats->nbytes = 0;
+    stats->nblocks = 0;
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats->nbytes += (uint64_t)shard.bytes;
+        stats->nblocks += shard.lru.size();
+    }
+}
+
+
+void blosc2_grok_reset_cache_stats() {
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+}
@@ -0,0 +1,61 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#ifndef BLOSC2_GROK_CACHE_H
+#define BLOSC2_GROK_CACHE_H
+
+#include <cstdint>
+
+// Opt-in LRU cache of decoded blocks, so that reading the same blocks again
+// costs a memcpy instead of a decode.  It is bounded in memory (see
+// blosc2_grok_set_decode_cache) and split into shards, each with its own lock,
+// so that the decompression threads of blosc2 rarely contend.  The memory
+// budget is shared by all the shards, so any block up to the whole budget is
+// cached; making room evicts from the shard of the new block first, and then
+// from the others.
+//
+// Blocks are looked up by their codestream: a hash of the compressed input
+// (and of the shared main header for headerless blocks), its length, the
+// size of the output and the number of layers decoded.  Every entry keeps a
+// copy of the compressed bytes too, so a hash collision is a miss, never
+// another block; the copy counts towards the memory used.
+
+struct cache_key {
+    uint64_t hash;
+    int32_t input_len;
+    int32_t output_len;
+    uint16_t layers;
+
+    bool operator==(const cache_key &other) const {
+        return hash == other.hash && input_len == other.input_len && output_len == other.output_len &&
+               layers == other.layers;
+    }
+};
+
+// Compressed bytes a block is decoded from
+struct cache_source {
+    const uint8_t *input;
+    int32_t input_len;
+    const uint8_t *header;      // main header of a headerless block, or nullptr
+    size_t header_len;
+};
+
+// Whether the cache is enabled (it is not by default)
+bool decode_cache_enabled();
+
+// Copy the cached block for `key` into `output` and return true, or return
+// false if it is not in the cache or was not decoded from `src`.
+bool cache_get(const cache_key &key, const cache_source &src, uint8_t *output, int32_t output_len);
+
+// Store a block decoded from `src`, evicting the least recently used ones if needed.
+void cache_put(const cache_key &key, const cache_source &src, const uint8_t *output, int32_t output_len);
+
+// Drop every cached block.
+void clear_decode_cache();
+
+#endif
@@ -0,0 +1,226 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "codestream.h"
+
+// Headers are cached by super-chunk address.  As for the encoder contexts,
+// every hit is validated against the live (compressed) vlmeta content, so
+// an entry of a freed super-chunk is never used for a new one.
+#define MAX_CACHED_HEADERS 64
+
+struct header_entry {
+    std::vector<uint8_t> vlmeta;   // compressed vlmeta content it was read from
+    shared_header header;
+};
+
+static std::shared_mutex headers_mutex;
+static std::unordered_map<const blosc2_schunk *, header_entry> headers;
+// Serializes the writers of the vlmeta entry
+static std::mutex store_mutex;
+
+
+static inline uint32_t read_be16(const uint8_t *p) {
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+
+int64_t get_main_header_len(const uint8_t *cs, size_t len) {
+    if (len < 2 || read_be16(cs) != J2K_SOC) {
+        return -1;
+    }
+    // Walk the marker segments of the main header until the first tile-part
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        uint32_t marker = read_be16(cs + pos);
+        if (marker == J2K_SOT) {
+            return (int64_t)pos;
+        }
+        if ((marker & 0xFF00) != 0xFF00) {
+            return -1;
+        }
+        pos += 2 + read_be16(cs + pos + 2);
+    }
+    return -1;
+}
+
+
+std::vector<uint8_t> copy_main_header(const uint8_t *cs, size_t hlen) {
+    std::vector<uint8_t> header(cs, cs + 2);
+    size_t pos = 2;
+    while (pos + 4 <= hlen) {
+        size_t seglen = 2 + read_be16(cs + pos + 2);
+        if (read_be16(cs + pos) != J2K_TLM) {
+            header.insert(header.end(), cs + pos, cs + std::min(pos + seglen, hlen));
+        }
+        pos += seglen;
+    }
+    return header;
+}
+
+
+int split_tile_parts(const uint8_t *cs, size_t len, uint32_t ntiles, std::vector<uint8_t> &header,
+                     std::vector<std::vector<uint8_t>> &tiles) {
+    int64_t hlen = get_main_header_len(cs, len);
+    if (hlen < 0) {
+        fprintf(stderr, "Cannot find the main header of the codestream\n");
+        return BLOSC2_ERROR_FAILURE;
+    }
+    header = copy_main_header(cs, hlen);
+    tiles.assign(ntiles, {});
+
+    // SOT segment: marker, Lsot, Isot (2 bytes), Psot (4 bytes), TPsot, TNsot
+    size_t pos = hlen;
+    while (pos + 12 <= len && read_be16(cs + pos) == J2K_SOT) {
+        uint32_t isot = read_be16(cs + pos + 4);
+        size_t psot = ((size_t)read_be16(cs + pos + 6) << 16) | read_be16(cs + pos + 8);
+        if (psot == 0) {
+            // Last tile-part, up to the EOC
+            psot = len - 2 - pos;
+        }
+        if (isot >= ntiles || pos + psot > len) {
+            fprintf(stderr, "Invalid tile-part in the codestream\n");
+            return BLOSC2_ERROR_FAILURE;
+        }
+        tiles[isot].insert(tiles[isot].end(), cs + pos, cs + pos + psot);
+        pos += psot;
+    }
+    for (auto &tile : tiles) {
+        tile.push_back(J2K_EOC >> 8);
+        tile.push_back(J2K_EOC & 0xFF);
+    }
+    return 0;
+}
+
+
+int32_t get_single_tile(const uint8_t *cs, size_t len, size_t offset) {
+    int32_t tile = -1;
+    size_t pos = offset;
+    while (pos + 12 <= len && read_be16(cs + pos) == J2K_SOT) {
+        int32_t isot = (int32_t)read_be16(cs + pos + 4);
+        size_t psot = ((size_t)read_be16(cs + pos + 6) << 16) | read_be16(cs + pos + 8);
+        if (tile >= 0 && isot != tile) {
+            return -1;
+        }
+        tile = isot;
+        if (psot == 0) {
+            break;
+        }
+        pos += psot;
+    }
+    return tile;
+}
+
+
+static const blosc2_metalayer *get_vlmetalayer(blosc2_schunk *schunk) {
+    int n = blosc2_vlmeta_exists(schunk, GROK_HEADER_VLMETA);
+    return n < 0 ? nullptr : schunk->vlmetalayers[n];
+}
+
+
+static bool entry_is_valid(const header_entry &entry, const blosc2_metalayer *meta) {
+    return entry.vlmeta.size() == (size_t)meta->content_len &&
+           memcmp(entry.vlmeta.data(), meta->content, meta->content_len) == 0;
+}
+
+
+// The header is stored as a msgpack bin, so that it can be read from Python
+static int read_header(blosc2_schunk *schunk, const blosc2_metalayer *meta, shared_header &header) {
+    uint8_t *content;
+    int32_t content_len;
+    BLOSC_ERROR(blosc2_vlmeta_get(schunk, GROK_HEADER_VLMETA, &content, &content_len));
+    size_t hlen = 0;
+    size_t offset = 0;
+    if (content_len >= 2 && content[0] == 0xc4) {
+        hlen = content[1];
+        offset = 2;
+    } else if (content_len >= 3 && content[0] == 0xc5) {
+        hlen = read_be16(content + 1);
+        offset = 3;
+    } else if (content_len >= 5 && content[0] == 0xc6) {
+        hlen = ((size_t)read_be16(content + 1) << 16) | read_be16(content + 3);
+        offset = 5;
+    }
+    if (offset == 0 || offset + hlen > (size_t)content_len) {
+        free(content);
+        fprintf(stderr, "Invalid grok header in vlmeta\n");
+        return BLOSC2_ERROR_INVALID_HEADER;
+    }
+    header = std::make_shared<const std::vector<uint8_t>>(content + offset, content + offset + hlen);
+    free(content);
+
+    header_entry entry = {std::vector<uint8_t>(meta->content, meta->content + meta->content_len), header};
+    std::unique_lock<std::shared_mutex> lock(headers_mutex);
+    if (headers.size() >= MAX_CACHED_HEADERS && headers.find(schunk) == headers.end()) {
+        headers.erase(headers.begin());
+    }
+    headers[schunk] = std::move(entry);
+    return 0;
+}
+
+
+int get_shared_header(blosc2_schunk *schunk, shared_header &header) {
+    header.reset();
+    if (schunk == nullptr) {
+        fprintf(stderr, "Headerless blocks need to be used from a super-chunk\n");
+        return BLOSC2_ERROR_NULL_POINTER;
+    }
+    const blosc2_metalayer *meta = get_vlmetalayer(schunk);
+    if (meta == nullptr) {
+        return 0;
+    }
+    {
+        std::shared_lock<std::shared_mutex> lock(headers_mutex);
+        auto it = headers.find(schunk);
+        if (it != headers.end() && entry_is_valid(it->second, meta)) {
+            header = it->second.header;
+            return 0;
+        }
+    }
+    return read_header(schunk, meta, header);
+}
+
+
+int set_shared_header(blosc2_schunk *schunk, shared_header &header) {
+    if (schunk == nullptr) {
+        fprintf(stderr, "Headerless blocks need to be used from a super-chunk\n");
+        return BLOSC2_ERROR_NULL_POINTER;
+    }
+    std::lock_guard<std::mutex> lock(store_mutex);
+    // Another block may have stored it in the meantime
+    shared_header stored;
+    BLOSC_ERROR(get_shared_header(schunk, stored));
+    if (stored != nullptr) {
+        header = stored;
+        return 0;
+    }
+
+    size_t hlen = header->size();
+    std::vector<uint8_t> content;
+    if (hlen <= UINT8_MAX) {
+        content = {0xc4, (uint8_t)hlen};
+    } else if (hlen <= UINT16_MAX) {
+        content = {0xc5, (uint8_t)(hlen >> 8), (uint8_t)hlen};
+    } else {
+        content = {0xc6, (uint8_t)(hlen >> 24), (uint8_t)(hlen >> 16), (uint8_t)(hlen >> 8), (uint8_t)hlen};
+    }
+    content.insert(content.end(), header->begin(), header->end());
+    BLOSC_ERROR(blosc2_vlmeta_add(schunk, GROK_HEADER_VLMETA, content.data(), (int32_t)content.size(), nullptr));
+    return 0;
+}
+
+
+void clear_shared_headers() {
+    std::unique_lock<std::shared_mutex> lock(headers_mutex);
+    headers.clear();
+}
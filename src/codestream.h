@@ -0,0 +1,66 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#ifndef BLOSC2_GROK_CODESTREAM_H
+#define BLOSC2_GROK_CODESTREAM_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "blosc2.h"
+
+// JPEG 2000 codestream markers
+#define J2K_SOC 0xFF4F
+#define J2K_SOT 0xFF90
+#define J2K_EOC 0xFFD9
+#define J2K_TLM 0xFF55
+#define J2K_PLT 0xFF58
+#define J2K_COD 0xFF52
+#define J2K_COC 0xFF53
+#define J2K_POC 0xFF5F
+#define J2K_PPM 0xFF60
+#define J2K_PPT 0xFF61
+#define J2K_SOD 0xFF93
+
+// vlmeta entry holding the main header shared by the headerless blocks
+#define GROK_HEADER_VLMETA "grok_header"
+
+typedef std::shared_ptr<const std::vector<uint8_t>> shared_header;
+
+// Length of the main header (SOC up to the first SOT) of a raw codestream,
+// or a negative value if `cs` does not start with a valid main header.
+int64_t get_main_header_len(const uint8_t *cs, size_t len);
+
+// Copy the main header of a raw codestream (its first `hlen` bytes) without
+// the TLM segments, which depend on the lengths of the tile-parts.
+std::vector<uint8_t> copy_main_header(const uint8_t *cs, size_t hlen);
+
+// Split a raw codestream into its main header (see copy_main_header) and the
+// tile-parts of every tile (`ntiles` of them, each one ending with an EOC, so
+// that header + tile is a valid codestream).  Returns 0 on success or a
+// negative BLOSC2_ERROR_* code.
+int split_tile_parts(const uint8_t *cs, size_t len, uint32_t ntiles, std::vector<uint8_t> &header,
+                     std::vector<std::vector<uint8_t>> &tiles);
+
+// Index of the tile of the tile-parts starting at `offset` in `cs`, or -1 if
+// they belong to more than one tile.
+int32_t get_single_tile(const uint8_t *cs, size_t len, size_t offset);
+
+// Get the main header shared by the blocks of `schunk`, or a null pointer if
+// there is none yet.  Returns 0 on success or a negative BLOSC2_ERROR_* code.
+int get_shared_header(blosc2_schunk *schunk, shared_header &header);
+
+// Store `header` as the main header shared by the blocks of `schunk`, unless
+// there is one already.  On success `header` is the one actually stored.
+int set_shared_header(blosc2_schunk *schunk, shared_header &header);
+
+// Drop every cached header.
+void clear_shared_headers();
+
+#endif
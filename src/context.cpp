@@ -0,0 +1,227 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "context.h"
+
+// Entries are keyed by super-chunk address.  Blosc2 does not tell plugins
+// when a super-chunk is freed, and its address can be handed out again, so
+// every hit is validated against the storage of the live super-chunk (which
+// is allocated along with it) and everything the context is built from.
+// When the cache is full, the least recently used entry is evicted.
+#define MAX_CACHED_CTXS 64
+
+struct cached_ctx {
+    std::shared_ptr<const encoder_ctx> ctx;
+    const blosc2_storage *storage;
+    std::atomic<uint64_t> last_use;  // value of use_clock when last looked up
+};
+
+static std::shared_mutex ctxs_mutex;
+static std::unordered_map<const blosc2_schunk *, cached_ctx> ctxs;
+static std::atomic<uint64_t> use_clock{0};
+
+// Per-thread copy of the last entry used, to avoid the lock for consecutive blocks
+static thread_local const blosc2_schunk *last_schunk = nullptr;
+static thread_local const blosc2_storage *last_storage = nullptr;
+static thread_local std::shared_ptr<const encoder_ctx> last_ctx;
+
+
+static bool ctx_is_valid(const encoder_ctx *ctx, const blosc2_storage *storage,
+                         const blosc2_schunk *schunk, const blosc2_metalayer *meta) {
+    return storage == schunk->storage &&
+           ctx->typesize == (uint32_t)schunk->typesize &&
+           ctx->b2nd_meta.size() == (size_t)meta->content_len &&
+           memcmp(ctx->b2nd_meta.data(), meta->content, meta->content_len) == 0;
+}
+
+
+static int build_encoder_ctx(blosc2_schunk *schunk, const blosc2_metalayer *meta,
+                             std::shared_ptr<const encoder_ctx> &ctx) {
+    auto new_ctx = std::make_shared<encoder_ctx>();
+    char *dtype;
+    BLOSC_ERROR(
+        b2nd_deserialize_meta(meta->content, meta->content_len, &new_ctx->ndim, new_ctx->shape,
+                              new_ctx->chunkshape, new_ctx->blockshape, &dtype, &new_ctx->dtype_format)
+    );
+    if (dtype != nullptr) {
+        new_ctx->dtype = dtype;
+        free(dtype);
+    }
+    new_ctx->b2nd_meta.assign(meta->content, meta->content + meta->content_len);
+
+    // Determine image dimensions
+    // Ignore leading dimensions if they are 1
+    int8_t ndim = new_ctx->ndim;
+    const int32_t *blockshape = new_ctx->blockshape;
+    uint32_t igdim = 0;
+    for (int i = 0; i < ndim; ++i) {
+        if (blockshape[i] == 1) {
+            igdim++;
+        } else {
+            break;
+        }
+    }
+    new_ctx->igdim = igdim;
+    new_ctx->numComps = 1;
+    switch (ndim - igdim) {
+        case 0:
+            new_ctx->height = 1;
+            new_ctx->width = 1;
+            break;
+        case 1:
+            new_ctx->height = 1;
+            new_ctx->width = blockshape[igdim];
+            break;
+        case 3:
+            // Single image with more than 1 component
+            new_ctx->numComps = blockshape[igdim + 2];
+            [[fallthrough]];
+        case 2:
+            new_ctx->height = blockshape[igdim];
+            new_ctx->width = blockshape[igdim + 1];
+            break;
+        case 4:
+            // Only as a stack of frames (see below)
+            new_ctx->height = 0;
+            new_ctx->width = 0;
+            new_ctx->numComps = 0;
+            break;
+        default:
+            fprintf(stderr, "Blocks with more than 4 non-unit dimensions are not supported\n");
+            return BLOSC2_ERROR_INVALID_PARAM;
+    }
+
+    new_ctx->planar_comps = 0;
+    new_ctx->planar_height = 0;
+    new_ctx->planar_width = 0;
+    if (ndim - igdim == 3) {
+        new_ctx->planar_comps = blockshape[igdim];
+        new_ctx->planar_height = blockshape[igdim + 1];
+        new_ctx->planar_width = blockshape[igdim + 2];
+    }
+
+    new_ctx->stack_frames = 0;
+    new_ctx->stack_height = 0;
+    new_ctx->stack_width = 0;
+    new_ctx->stack_comps = 0;
+    if (ndim - igdim >= 3) {
+        new_ctx->stack_frames = blockshape[igdim];
+        new_ctx->stack_height = blockshape[igdim + 1];
+        new_ctx->stack_width = blockshape[igdim + 2];
+        new_ctx->stack_comps = ndim - igdim == 4 ? blockshape[igdim + 3] : 1;
+    }
+
+    new_ctx->nblocks = 1;
+    for (int i = 0; i < ndim; ++i) {
+        if (blockshape[i] != 0) {
+            new_ctx->nblocks *= (new_ctx->chunkshape[i] + blockshape[i] - 1) / blockshape[i];
+        }
+    }
+
+    const int32_t *chunkshape = new_ctx->chunkshape;
+    new_ctx->tileable = ndim - igdim >= 1 && ndim - igdim <= 3;
+    for (uint32_t i = 0; i < igdim; ++i) {
+        new_ctx->tileable &= chunkshape[i] == 1;
+    }
+    new_ctx->tiles_y = 1;
+    new_ctx->tiles_x = 1;
+    switch (ndim - igdim) {
+        case 3:
+            new_ctx->tileable &= chunkshape[igdim + 2] == blockshape[igdim + 2];
+            [[fallthrough]];
+        case 2:
+            new_ctx->tiles_y = (chunkshape[igdim] + blockshape[igdim] - 1) / blockshape[igdim];
+            new_ctx->tiles_x = (chunkshape[igdim + 1] + blockshape[igdim + 1] - 1) / blockshape[igdim + 1];
+            break;
+        case 1:
+            new_ctx->tiles_x = (chunkshape[igdim] + blockshape[igdim] - 1) / blockshape[igdim];
+            break;
+    }
+
+    new_ctx->typesize = schunk->typesize;
+    new_ctx->precision = 8 * new_ctx->typesize;
+    // NumPy dtype strings are like '<i2' or '|u1'; other formats are taken as unsigned
+    const std::string &dt = new_ctx->dtype;
+    size_t pos = dt.find_first_not_of("<>|=");
+    const char kind = new_ctx->dtype_format == 0 && pos != std::string::npos ? dt[pos] : 'u';
+    new_ctx->sgnd = kind == 'i';
+    new_ctx->floating = kind == 'f' && new_ctx->typesize == 4;
+
+    ctx = std::move(new_ctx);
+    return 0;
+}
+
+
+int get_encoder_ctx(blosc2_schunk *schunk, std::shared_ptr<const encoder_ctx> &ctx) {
+    ctx.reset();
+    if (schunk == nullptr) {
+        fprintf(stderr, "The grok codec needs to be used from a b2nd array\n");
+        return BLOSC2_ERROR_NULL_POINTER;
+    }
+    int nmeta = blosc2_meta_exists(schunk, "b2nd");
+    if (nmeta < 0) {
+        fprintf(stderr, "b2nd metalayer not found\n");
+        return BLOSC2_ERROR_METALAYER_NOT_FOUND;
+    }
+    const blosc2_metalayer *meta = schunk->metalayers[nmeta];
+
+    // Fast path: same super-chunk as the previous block in this thread
+    if (last_schunk == schunk && ctx_is_valid(last_ctx.get(), last_storage, schunk, meta)) {
+        ctx = last_ctx;
+        return 0;
+    }
+
+    {
+        std::shared_lock<std::shared_mutex> lock(ctxs_mutex);
+        auto it = ctxs.find(schunk);
+        if (it != ctxs.end() && ctx_is_valid(it->second.ctx.get(), it->second.storage, schunk, meta)) {
+            it->second.last_use.store(++use_clock, std::memory_order_relaxed);
+            ctx = it->second.ctx;
+        }
+    }
+
+    if (ctx == nullptr) {
+        BLOSC_ERROR(build_encoder_ctx(schunk, meta, ctx));
+        std::unique_lock<std::shared_mutex> lock(ctxs_mutex);
+        auto it = ctxs.find(schunk);
+        if (it == ctxs.end()) {
+            if (ctxs.size() >= MAX_CACHED_CTXS) {
+                // Blocks in flight keep their own reference to an evicted context
+                auto lru = ctxs.begin();
+                for (auto e = ctxs.begin(); e != ctxs.end(); ++e) {
+                    if (e->second.last_use.load(std::memory_order_relaxed) <
+                        lru->second.last_use.load(std::memory_order_relaxed)) {
+                        lru = e;
+                    }
+                }
+                ctxs.erase(lru);
+            }
+            it = ctxs.try_emplace(schunk).first;
+        }
+        it->second.ctx = ctx;
+        it->second.storage = schunk->storage;
+        it->second.last_use.store(++use_clock, std::memory_order_relaxed);
+    }
+
+    last_schunk = schunk;
+    last_storage = schunk->storage;
+    last_ctx = ctx;
+    return 0;
+}
+
+
+void clear_encoder_ctxs() {
+    std::unique_lock<std::shared_mutex> lock(ctxs_mutex);
+    ctxs.clear();
+}
@@ -0,0 +1,74 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#ifndef BLOSC2_GROK_CONTEXT_H
+#define BLOSC2_GROK_CONTEXT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "blosc2.h"
+#include "b2nd.h"
+
+// Everything the encoder derives from the b2nd metalayer of a super-chunk.
+// It never changes during the life of the super-chunk, so it is computed
+// once and shared (read-only) by every block and every thread.
+struct encoder_ctx {
+    int8_t ndim;
+    int64_t shape[BLOSC2_MAX_DIM];
+    int32_t chunkshape[BLOSC2_MAX_DIM];
+    int32_t blockshape[BLOSC2_MAX_DIM];
+    std::string dtype;
+    int8_t dtype_format;
+
+    uint32_t igdim;      // number of leading dimensions equal to 1
+    uint32_t width;      // image columns (0 for blocks that can only be stacks)
+    uint32_t height;     // image rows
+    uint32_t numComps;
+    uint32_t typesize;
+    uint32_t precision;
+    bool sgnd;           // signed samples (a NumPy dtype of kind 'i')
+    bool floating;       // float32 samples
+    uint32_t nblocks;    // blocks per chunk
+
+    // Geometry in the planar (C, H, W) layout, where the first non-unit
+    // dimension holds the components, each one a contiguous plane.  Only for
+    // blocks with 3 non-unit dimensions (planar_comps is 0 otherwise).
+    uint32_t planar_comps;
+    uint32_t planar_height;
+    uint32_t planar_width;
+
+    // Geometry as a stack of frames (S, H, W) or (S, H, W, C), where the first
+    // non-unit dimension holds the frames, each one an interleaved image.  For
+    // blocks with 3 or 4 non-unit dimensions (stack_frames is 0 otherwise).
+    uint32_t stack_frames;
+    uint32_t stack_height;
+    uint32_t stack_width;
+    uint32_t stack_comps;
+
+    // Grid of blocks in a chunk, for the tiled chunk mode.  It is only
+    // possible when the chunk is 1 along the leading (ignored) dimensions
+    // and holds all the components.
+    bool tileable;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+
+    // Raw b2nd metalayer this context was built from.  Used, with typesize,
+    // to validate the cache entry when a super-chunk address is reused.
+    std::vector<uint8_t> b2nd_meta;
+};
+
+// Get the (cached) encoder context for `schunk`.  Returns 0 on success or
+// a negative BLOSC2_ERROR_* code.
+int get_encoder_ctx(blosc2_schunk *schunk, std::shared_ptr<const encoder_ctx> &ctx);
+
+// Drop every cached context.
+void clear_encoder_ctxs();
+
+#endif
@@ -0,0 +1,967 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+enum simd_level {
+    SIMD_SCALAR,
+    SIMD_SSE41,
+    SIMD_AVX2,
+    SIMD_NEON,
+};
+
+
+static simd_level detect_simd() {
+    // Allow forcing the portable code path (handy for benchmarking and debugging)
+    const char *env = getenv("BLOSC2_GROK_SIMD");
+    if (env != nullptr && strcmp(env, "scalar") == 0) {
+        return SIMD_SCALAR;
+    }
+#if defined(KERNELS_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int nids = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx2 = false;
+    if (nids >= 7 && osxsave && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) {
+        return SIMD_AVX2;
+    }
+    if (sse41) {
+        return SIMD_SSE41;
+    }
+    return SIMD_SCALAR;
+#elif defined(KERNELS_NEON)
+    return SIMD_NEON;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+
+static simd_level get_simd_level() {
+    static const simd_level level = detect_simd();
+    return level;
+}
+
+
+const char *get_simd_name() {
+    switch (get_simd_level()) {
+        case SIMD_AVX2:
+            return "avx2";
+        case SIMD_SSE41:
+            return "sse4.1";
+        case SIMD_NEON:
+            return "neon";
+        default:
+            return "scalar";
+    }
+}
+
+
+/* Scalar kernels.  `src` points to pixel `i`; N == 0 means `numComps` components. */
+
+template <typename T, uint32_t N>
+static inline void fill_scalar(const uint8_t *src, int32_t *const *dst, uint32_t i, uint32_t npixels,
+                               uint32_t numComps) {
+    const uint32_t ncomp = N ? N : numComps;
+    for (; i < npixels; ++i) {
+        for (uint32_t c = 0; c < ncomp; ++c) {
+            T v;
+            memcpy(&v, src, sizeof(T));
+            src += sizeof(T);
+            dst[c][i] = (int32_t)v;
+        }
+    }
+}
+
+template <typename T, uint32_t N>
+static void fill_row_scalar(const uint8_t *src, int32_t *const *dst, uint32_t npixels, uint32_t numComps) {
+    fill_scalar<T, N>(src, dst, 0, npixels, numComps);
+}
+
+
+template <typename T, uint32_t N>
+static inline void store_scalar(const int32_t *const *src, uint8_t *dst, uint32_t i, uint32_t npixels,
+                                uint32_t numComps) {
+    const uint32_t ncomp = N ? N : numComps;
+    const int64_t minval = (int64_t)std::numeric_limits<T>::min();
+    const int64_t maxval = (int64_t)std::numeric_limits<T>::max();
+    for (; i < npixels; ++i) {
+        for (uint32_t c = 0; c < ncomp; ++c) {
+            int64_t v = src[c][i];
+            T t = (T)(v < minval ? minval : (v > maxval ? maxval : v));
+            memcpy(dst, &t, sizeof(T));
+            dst += sizeof(T);
+        }
+    }
+}
+
+template <typename T, uint32_t N>
+static void store_row_scalar(const int32_t *const *src, uint8_t *dst, uint32_t npixels, uint32_t numComps) {
+    store_scalar<T, N>(src, dst, 0, npixels, numComps);
+}
+
+
+#if defined(KERNELS_X86)
+
+/* pshufb masks.  `gather_mask` picks component `comp` out of the `vec`-th
+ * 16-byte vector of a run of 16 / esize interleaved pixels, so that OR-ing
+ * the result for every vector of the run gives the full component.
+ * `group_mask` regroups the pixels of a single vector by component. */
+
+static constexpr std::array<uint8_t, 16> gather_mask(int esize, int ncomp, int comp, int vec) {
+    std::array<uint8_t, 16> m{};
+    for (int i = 0; i < 16; ++i) {
+        int src = ((i / esize) * ncomp + comp) * esize + i % esize;
+        m[i] = (src / 16 == vec) ? (uint8_t)(src % 16) : 0x80;
+    }
+    return m;
+}
+
+// Inverse of gather_mask: fill output vector `vec` of the interleaved run with component `comp`
+static constexpr std::array<uint8_t, 16> scatter_mask(int esize, int ncomp, int comp, int vec) {
+    std::array<uint8_t, 16> m{};
+    for (int i = 0; i < 16; ++i) {
+        int elem = (16 * vec + i) / esize;
+        int src = (elem / ncomp) * esize + i % esize;
+        m[i] = (elem % ncomp == comp) ? (uint8_t)src : 0x80;
+    }
+    return m;
+}
+
+static constexpr std::array<uint8_t, 16> group_mask(int esize, int ncomp) {
+    std::array<uint8_t, 16> m{};
+    const int npix = 16 / esize / ncomp;
+    for (int i = 0; i < 16; ++i) {
+        int elem = i / esize;
+        int src = ((elem % npix) * ncomp + elem / npix) * esize + i % esize;
+        m[i] = (uint8_t)src;
+    }
+    return m;
+}
+
+template <int ESIZE>
+static constexpr std::array<std::array<uint8_t, 16>, 9> gather_masks_c3() {
+    std::array<std::array<uint8_t, 16>, 9> m{};
+    for (int comp = 0; comp < 3; ++comp) {
+        for (int vec = 0; vec < 3; ++vec) {
+            m[comp * 3 + vec] = gather_mask(ESIZE, 3, comp, vec);
+        }
+    }
+    return m;
+}
+
+template <int ESIZE>
+static constexpr std::array<std::array<uint8_t, 16>, 9> scatter_masks_c3() {
+    std::array<std::array<uint8_t, 16>, 9> m{};
+    for (int comp = 0; comp < 3; ++comp) {
+        for (int vec = 0; vec < 3; ++vec) {
+            m[vec * 3 + comp] = scatter_mask(ESIZE, 3, comp, vec);
+        }
+    }
+    return m;
+}
+
+static inline __m128i load_mask(const std::array<uint8_t, 16> &m) {
+    return _mm_loadu_si128((const __m128i *)m.data());
+}
+
+// Zero- or sign-extend the low samples of type T in `v` to int32
+template <typename T>
+static inline TARGET_SSE41 __m128i widen_sse41(__m128i v) {
+    if constexpr (sizeof(T) == 1) {
+        return std::is_signed_v<T> ? _mm_cvtepi8_epi32(v) : _mm_cvtepu8_epi32(v);
+    } else {
+        return std::is_signed_v<T> ? _mm_cvtepi16_epi32(v) : _mm_cvtepu16_epi32(v);
+    }
+}
+
+// Widen the 16 / sizeof(T) samples in `v` and store them at `d`
+template <typename T>
+static inline TARGET_SSE41 void widen_store_sse41(int32_t *d, __m128i v) {
+    if constexpr (sizeof(T) == 1) {
+        _mm_storeu_si128((__m128i *)d, widen_sse41<T>(v));
+        _mm_storeu_si128((__m128i *)(d + 4), widen_sse41<T>(_mm_srli_si128(v, 4)));
+        _mm_storeu_si128((__m128i *)(d + 8), widen_sse41<T>(_mm_srli_si128(v, 8)));
+        _mm_storeu_si128((__m128i *)(d + 12), widen_sse41<T>(_mm_srli_si128(v, 12)));
+    } else {
+        _mm_storeu_si128((__m128i *)d, widen_sse41<T>(v));
+        _mm_storeu_si128((__m128i *)(d + 4), widen_sse41<T>(_mm_srli_si128(v, 8)));
+    }
+}
+
+template <typename T>
+static TARGET_SSE41 void fill_row_c1_sse41(const uint8_t *src, int32_t *const *dst, uint32_t npixels,
+                                           uint32_t numComps) {
+    constexpr uint32_t step = 16 / sizeof(T);
+    uint32_t i = 0;
+    for (; i + step <= npixels; i += step) {
+        widen_store_sse41<T>(dst[0] + i, _mm_loadu_si128((const __m128i *)src));
+        src += 16;
+    }
+    fill_scalar<T, 1>(src, dst, i, npixels, numComps);
+}
+
+template <typename T>
+static TARGET_SSE41 void fill_row_c3_sse41(const uint8_t *src, int32_t *const *dst, uint32_t npixels,
+                                           uint32_t numComps) {
+    static constexpr auto masks = gather_masks_c3<sizeof(T)>();
+    constexpr uint32_t step = 16 / sizeof(T);
+    __m128i m[9];
+    for (int k = 0; k < 9; ++k) {
+        m[k] = load_mask(masks[k]);
+    }
+    uint32_t i = 0;
+    for (; i + step <= npixels; i += step) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)src);
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(src + 32));
+        for (int c = 0; c < 3; ++c) {
+            __m128i g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, m[c * 3]), _mm_shuffle_epi8(v1, m[c * 3 + 1])),
+                                     _mm_shuffle_epi8(v2, m[c * 3 + 2]));
+            widen_store_sse41<T>(dst[c] + i, g);
+        }
+        src += 48;
+    }
+    fill_scalar<T, 3>(src, dst, i, npixels, numComps);
+}
+
+static TARGET_SSE41 void fill_row_u8c4_sse41(const uint8_t *src, int32_t *const *dst, uint32_t npixels,
+                                             uint32_t numComps) {
+    static constexpr auto mask = group_mask(1, 4);
+    const __m128i m = load_mask(mask);
+    uint32_t i = 0;
+    for (; i + 4 <= npixels; i += 4) {
+        // R0-3 G0-3 B0-3 A0-3
+        __m128i g = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), m);
+        _mm_storeu_si128((__m128i *)(dst[0] + i), _mm_cvtepu8_epi32(g));
+        _mm_storeu_si128((__m128i *)(dst[1] + i), _mm_cvtepu8_epi32(_mm_srli_si128(g, 4)));
+        _mm_storeu_si128((__m128i *)(dst[2] + i), _mm_cvtepu8_epi32(_mm_srli_si128(g, 8)));
+        _mm_storeu_si128((__m128i *)(dst[3] + i), _mm_cvtepu8_epi32(_mm_srli_si128(g, 12)));
+        src += 16;
+    }
+    fill_scalar<uint8_t, 4>(src, dst, i, npixels, numComps);
+}
+
+static TARGET_SSE41 void fill_row_u16c4_sse41(const uint8_t *src, int32_t *const *dst, uint32_t npixels,
+                                              uint32_t numComps) {
+    static constexpr auto mask = group_mask(2, 4);
+    const __m128i m = load_mask(mask);
+    uint32_t i = 0;
+    for (; i + 4 <= npixels; i += 4) {
+        // R0R1 G0G1 B0B1 A0A1 and R2R3 G2G3 B2B3 A2A3
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), m);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 16)), m);
+        __m128i lo = _mm_unpacklo_epi32(a, b);
+        __m128i hi = _mm_unpackhi_epi32(a, b);
+        _mm_storeu_si128((__m128i *)(dst[0] + i), _mm_cvtepu16_epi32(lo));
+        _mm_storeu_si128((__m128i *)(dst[1] + i), _mm_cvtepu16_epi32(_mm_srli_si128(lo, 8)));
+        _mm_storeu_si128((__m128i *)(dst[2] + i), _mm_cvtepu16_epi32(hi));
+        _mm_storeu_si128((__m128i *)(dst[3] + i), _mm_cvtepu16_epi32(_mm_srli_si128(hi, 8)));
+        src += 32;
+    }
+    fill_scalar<uint16_t, 4>(src, dst, i, npixels, numComps);
+}
+
+// Zero- or sign-extend the low 8 samples of type T in `v` to int32
+template <typename T>
+static inline TARGET_AVX2 __m256i widen_avx2(__m128i v) {
+    if constexpr (sizeof(T) == 1) {
+        return std::is_signed_v<T> ? _mm256_cvtepi8_epi32(v) : _mm256_cvtepu8_epi32(v);
+    } else {
+        return std::is_signed_v<T> ? _mm256_cvtepi16_epi32(v) : _mm256_cvtepu16_epi32(v);
+    }
+}
+
+template <typename T>
+static TARGET_AVX2 void fill_row_c1_avx2(const uint8_t *src, int32_t *const *dst, uint32_t npixels,
+                                         uint32_t numComps) {
+    int32_t *d = dst[0];
+    uint32_t i = 0;
+    for (; i + 16 <= npixels; i += 16) {
+        if constexpr (sizeof(T) == 1) {
+            __m128i v = _mm_loadu_si128((const __m128i *)src);
+            _mm256_storeu_si256((__m256i *)(d + i), widen_avx2<T>(v));
+            _mm256_storeu_si256((__m256i *)(d + i + 8), widen_avx2<T>(_mm_srli_si128(v, 8)));
+        } else {
+            __m256i v = _mm256_loadu_si256((const __m256i *)src);
+            _mm256_storeu_si256((__m256i *)(d + i), widen_avx2<T>(_mm256_castsi256_si128(v)));
+            _mm256_storeu_si256((__m256i *)(d + i + 8), widen_avx2<T>(_mm256_extracti128_si256(v, 1)));
+        }
+        src += 16 * sizeof(T);
+    }
+    fill_scalar<T, 1>(src, dst, i, npixels, numComps);
+}
+
+static TARGET_AVX2 void fill_row_u8c4_avx2(const uint8_t *src, int32_t *const *dst, uint32_t npixels,
+                                           uint32_t numComps) {
+    static constexpr auto mask = group_mask(1, 4);
+    const __m128i m128 = load_mask(mask);
+    const __m256i m = _mm256_broadcastsi128_si256(m128);
+    const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    uint32_t i = 0;
+    for (; i + 8 <= npixels; i += 8) {
+        // Per lane: R G B A groups of 4 pixels; then R0-7 G0-7 | B0-7 A0-7
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)src), m);
+        v = _mm256_permutevar8x32_epi32(v, perm);
+        __m128i lo = _mm256_castsi256_si128(v);
+        __m128i hi = _mm256_extracti128_si256(v, 1);
+        _mm256_storeu_si256((__m256i *)(dst[0] + i), _mm256_cvtepu8_epi32(lo));
+        _mm256_storeu_si256((__m256i *)(dst[1] + i), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+        _mm256_storeu_si256((__m256i *)(dst[2] + i), _mm256_cvtepu8_epi32(hi));
+        _mm256_storeu_si256((__m256i *)(dst[3] + i), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+        src += 32;
+    }
+    fill_scalar<uint8_t, 4>(src, dst, i, npixels, numComps);
+}
+
+// Load 16 / sizeof(T) int32 samples from `s` and narrow them (saturating to the range of T) into one vector
+template <typename T>
+static inline TARGET_SSE41 __m128i load_narrow_sse41(const int32_t *s) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *)s);
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(s + 4));
+    if constexpr (sizeof(T) == 1) {
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(s + 8));
+        __m128i v3 = _mm_loadu_si128((const __m128i *)(s + 12));
+        // signed saturation first, as packus_epi16 reads its input as int16
+        __m128i lo = _mm_packs_epi32(v0, v1);
+        __m128i hi = _mm_packs_epi32(v2, v3);
+        return std::is_signed_v<T> ? _mm_packs_epi16(lo, hi) : _mm_packus_epi16(lo, hi);
+    } else {
+        return std::is_signed_v<T> ? _mm_packs_epi32(v0, v1) : _mm_packus_epi32(v0, v1);
+    }
+}
+
+template <typename T>
+static TARGET_SSE41 void store_row_c1_sse41(const int32_t *const *src, uint8_t *dst, uint32_t npixels,
+                                            uint32_t numComps) {
+    constexpr uint32_t step = 16 / sizeof(T);
+    uint32_t i = 0;
+    for (; i + step <= npixels; i += step) {
+        _mm_storeu_si128((__m128i *)dst, load_narrow_sse41<T>(src[0] + i));
+        dst += 16;
+    }
+    store_scalar<T, 1>(src, dst, i, npixels, numComps);
+}
+
+template <typename T>
+static TARGET_SSE41 void store_row_c3_sse41(const int32_t *const *src, uint8_t *dst, uint32_t npixels,
+                                            uint32_t numComps) {
+    static constexpr auto masks = scatter_masks_c3<sizeof(T)>();
+    constexpr uint32_t step = 16 / sizeof(T);
+    __m128i m[9];
+    for (int k = 0; k < 9; ++k) {
+        m[k] = load_mask(masks[k]);
+    }
+    uint32_t i = 0;
+    for (; i + step <= npixels; i += step) {
+        __m128i c0 = load_narrow_sse41<T>(src[0] + i);
+        __m128i c1 = load_narrow_sse41<T>(src[1] + i);
+        __m128i c2 = load_narrow_sse41<T>(src[2] + i);
+        for (int v = 0; v < 3; ++v) {
+            __m128i o = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(c0, m[v * 3]), _mm_shuffle_epi8(c1, m[v * 3 + 1])),
+                                     _mm_shuffle_epi8(c2, m[v * 3 + 2]));
+            _mm_storeu_si128((__m128i *)(dst + 16 * v), o);
+        }
+        dst += 48;
+    }
+    store_scalar<T, 3>(src, dst, i, npixels, numComps);
+}
+
+static TARGET_SSE41 void store_row_u8c4_sse41(const int32_t *const *src, uint8_t *dst, uint32_t npixels,
+                                              uint32_t numComps) {
+    uint32_t i = 0;
+    for (; i + 16 <= npixels; i += 16) {
+        __m128i r = load_narrow_sse41<uint8_t>(src[0] + i);
+        __m128i g = load_narrow_sse41<uint8_t>(src[1] + i);
+        __m128i b = load_narrow_sse41<uint8_t>(src[2] + i);
+        __m128i a = load_narrow_sse41<uint8_t>(src[3] + i);
+        __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+        __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+        __m128i ba_lo = _mm_unpacklo_epi8(b, a);
+        __m128i ba_hi = _mm_unpackhi_epi8(b, a);
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi16(rg_hi, ba_hi));
+        _mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi16(rg_hi, ba_hi));
+        dst += 64;
+    }
+    store_scalar<uint8_t, 4>(src, dst, i, npixels, numComps);
+}
+
+static TARGET_SSE41 void store_row_u16c4_sse41(const int32_t *const *src, uint8_t *dst, uint32_t npixels,
+                                               uint32_t numComps) {
+    uint32_t i = 0;
+    for (; i + 8 <= npixels; i += 8) {
+        __m128i r = load_narrow_sse41<uint16_t>(src[0] + i);
+        __m128i g = load_narrow_sse41<uint16_t>(src[1] + i);
+        __m128i b = load_narrow_sse41<uint16_t>(src[2] + i);
+        __m128i a = load_narrow_sse41<uint16_t>(src[3] + i);
+        __m128i rg_lo = _mm_unpacklo_epi16(r, g);
+        __m128i rg_hi = _mm_unpackhi_epi16(r, g);
+        __m128i ba_lo = _mm_unpacklo_epi16(b, a);
+        __m128i ba_hi = _mm_unpackhi_epi16(b, a);
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi32(rg_lo, ba_lo));
+        _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi32(rg_lo, ba_lo));
+        _mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi32(rg_hi, ba_hi));
+        _mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi32(rg_hi, ba_hi));
+        dst += 64;
+    }
+    store_scalar<uint16_t, 4>(src, dst, i, npixels, numComps);
+}
+
+template <typename T>
+static TARGET_AVX2 void store_row_c1_avx2(const int32_t *const *src, uint8_t *dst, uint32_t npixels,
+                                          uint32_t numComps) {
+    const int32_t *s = src[0];
+    constexpr uint32_t step = 32 / sizeof(T);
+    uint32_t i = 0;
+    for (; i + step <= npixels; i += step) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(s + i + 8));
+        __m256i v;
+        if constexpr (sizeof(T) == 1) {
+            const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+            __m256i a = _mm256_packs_epi32(v0, v1);
+            __m256i b = _mm256_packs_epi32(_mm256_loadu_si256((const __m256i *)(s + i + 16)),
+                                           _mm256_loadu_si256((const __m256i *)(s + i + 24)));
+            v = std::is_signed_v<T> ? _mm256_packs_epi16(a, b) : _mm256_packus_epi16(a, b);
+            // packs work within lanes; restore the sample order afterwards
+            v = _mm256_permutevar8x32_epi32(v, perm);
+        } else {
+            v = std::is_signed_v<T> ? _mm256_packs_epi32(v0, v1) : _mm256_packus_epi32(v0, v1);
+            v = _mm256_permute4x64_epi64(v, 0xD8);
+        }
+        _mm256_storeu_si256((__m256i *)dst, v);
+        dst += 32;
+    }
+    store_scalar<T, 1>(src, dst, i, npixels, numComps);
+}
+
+#endif  // KERNELS_X86
+
+
+#if defined(KERNELS_NEON)
+
+// Samples are loaded as unsigned vectors; T decides between zero- and sign-extension
+template <typename T>
+static inline void widen_store_neon(int32_t *d, uint8x16_t v) {
+    if constexpr (std::is_signed_v<T>) {
+        int8x16_t sv = vreinterpretq_s8_u8(v);
+        int16x8_t lo = vmovl_s8(vget_low_s8(sv));
+        int16x8_t hi = vmovl_s8(vget_high_s8(sv));
+        vst1q_s32(d, vmovl_s16(vget_low_s16(lo)));
+        vst1q_s32(d + 4, vmovl_s16(vget_high_s16(lo)));
+        vst1q_s32(d + 8, vmovl_s16(vget_low_s16(hi)));
+        vst1q_s32(d + 12, vmovl_s16(vget_high_s16(hi)));
+    } else {
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+        vst1q_s32(d, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(lo))));
+        vst1q_s32(d + 4, vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(lo))));
+        vst1q_s32(d + 8, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(hi))));
+        vst1q_s32(d + 12, vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(hi))));
+    }
+}
+
+template <typename T>
+static inline void widen_store_neon(int32_t *d, uint16x8_t v) {
+    if constexpr (std::is_signed_v<T>) {
+        int16x8_t sv = vreinterpretq_s16_u16(v);
+        vst1q_s32(d, vmovl_s16(vget_low_s16(sv)));
+        vst1q_s32(d + 4, vmovl_s16(vget_high_s16(sv)));
+    } else {
+        vst1q_s32(d, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(v))));
+        vst1q_s32(d + 4, vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(v))));
+    }
+}
+
+// vld1/vld3/vld4 deinterleave in the load itself
+template <typename T, uint32_t N>
+static void fill_row_neon(const uint8_t *src, int32_t *const *dst, uint32_t npixels, uint32_t numComps) {
+    constexpr uint32_t step = 16 / sizeof(T);
+    uint32_t i = 0;
+    for (; i + step <= npixels; i += step) {
+        if constexpr (sizeof(T) == 1) {
+            if constexpr (N == 1) {
+                widen_store_neon<T>(dst[0] + i, vld1q_u8(src));
+            } else if constexpr (N == 3) {
+                uint8x16x3_t v = vld3q_u8(src);
+                for (uint32_t c = 0; c < 3; ++c) widen_store_neon<T>(dst[c] + i, v.val[c]);
+            } else {
+                uint8x16x4_t v = vld4q_u8(src);
+                for (uint32_t c = 0; c < 4; ++c) widen_store_neon<T>(dst[c] + i, v.val[c]);
+            }
+        } else {
+            const uint16_t *s = (const uint16_t *)src;
+            if constexpr (N == 1) {
+                widen_store_neon<T>(dst[0] + i, vld1q_u16(s));
+            } else if constexpr (N == 3) {
+                uint16x8x3_t v = vld3q_u16(s);
+                for (uint32_t c = 0; c < 3; ++c) widen_store_neon<T>(dst[c] + i, v.val[c]);
+            } else {
+                uint16x8x4_t v = vld4q_u16(s);
+                for (uint32_t c = 0; c < 4; ++c) widen_store_neon<T>(dst[c] + i, v.val[c]);
+            }
+        }
+        src += step * N * sizeof(T);
+    }
+    fill_scalar<T, N>(src, dst, i, npixels, numComps);
+}
+
+// Saturate to the range of T; the result is returned as an unsigned vector for the stores
+template <typename T>
+static inline uint8x16_t load_narrow_u8_neon(const int32_t *s) {
+    if constexpr (std::is_signed_v<T>) {
+        int16x8_t lo = vcombine_s16(vqmovn_s32(vld1q_s32(s)), vqmovn_s32(vld1q_s32(s + 4)));
+        int16x8_t hi = vcombine_s16(vqmovn_s32(vld1q_s32(s + 8)), vqmovn_s32(vld1q_s32(s + 12)));
+        return vreinterpretq_u8_s8(vcombine_s8(vqmovn_s16(lo), vqmovn_s16(hi)));
+    } else {
+        uint16x8_t lo = vcombine_u16(vqmovun_s32(vld1q_s32(s)), vqmovun_s32(vld1q_s32(s + 4)));
+        uint16x8_t hi = vcombine_u16(vqmovun_s32(vld1q_s32(s + 8)), vqmovun_s32(vld1q_s32(s + 12)));
+        return vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi));
+    }
+}
+
+template <typename T>
+static inline uint16x8_t load_narrow_u16_neon(const int32_t *s) {
+    if constexpr (std::is_signed_v<T>) {
+        return vreinterpretq_u16_s16(vcombine_s16(vqmovn_s32(vld1q_s32(s)), vqmovn_s32(vld1q_s32(s + 4))));
+    } else {
+        return vcombine_u16(vqmovun_s32(vld1q_s32(s)), vqmovun_s32(vld1q_s32(s + 4)));
+    }
+}
+
+// vst1/vst3/vst4 interleave in the store itself
+template <typename T, uint32_t N>
+static void store_row_neon(const int32_t *const *src, uint8_t *dst, uint32_t npixels, uint32_t numComps) {
+    constexpr uint32_t step = 16 / sizeof(T);
+    uint32_t i = 0;
+    for (; i + step <= npixels; i += step) {
+        if constexpr (sizeof(T) == 1) {
+            if constexpr (N == 1) {
+                vst1q_u8(dst, load_narrow_u8_neon<T>(src[0] + i));
+            } else if constexpr (N == 3) {
+                uint8x16x3_t v;
+                for (uint32_t c = 0; c < 3; ++c) v.val[c] = load_narrow_u8_neon<T>(src[c] + i);
+                vst3q_u8(dst, v);
+            } else {
+                uint8x16x4_t v;
+                for (uint32_t c = 0; c < 4; ++c) v.val[c] = load_narrow_u8_neon<T>(src[c] + i);
+                vst4q_u8(dst, v);
+            }
+        } else {
+            uint16_t *d = (uint16_t *)dst;
+            if constexpr (N == 1) {
+                vst1q_u16(d, load_narrow_u16_neon<T>(src[0] + i));
+            } else if constexpr (N == 3) {
+                uint16x8x3_t v;
+                for (uint32_t c = 0; c < 3; ++c) v.val[c] = load_narrow_u16_neon<T>(src[c] + i);
+                vst3q_u16(d, v);
+            } else {
+                uint16x8x4_t v;
+                for (uint32_t c = 0; c < 4; ++c) v.val[c] = load_narrow_u16_neon<T>(src[c] + i);
+                vst4q_u16(d, v);
+            }
+        }
+        dst += step * N * sizeof(T);
+    }
+    store_scalar<T, N>(src, dst, i, npixels, numComps);
+}
+
+#endif  // KERNELS_NEON
+
+
+template <typename T, uint32_t N>
+static fill_row_fn select_fill_kernel(simd_level simd) {
+#if defined(KERNELS_X86)
+    if (simd == SIMD_AVX2) {
+        if constexpr (N == 1) return fill_row_c1_avx2<T>;
+        if constexpr (N == 4 && std::is_same_v<T, uint8_t>) return fill_row_u8c4_avx2;
+    }
+    if (simd >= SIMD_SSE41) {
+        if constexpr (N == 1) return fill_row_c1_sse41<T>;
+        if constexpr (N == 3) return fill_row_c3_sse41<T>;
+        if constexpr (N == 4 && std::is_same_v<T, uint8_t>) return fill_row_u8c4_sse41;
+        if constexpr (N == 4 && std::is_same_v<T, uint16_t>) return fill_row_u16c4_sse41;
+    }
+#elif defined(KERNELS_NEON)
+    if (simd == SIMD_NEON) {
+        return fill_row_neon<T, N>;
+    }
+#endif
+    (void)simd;
+    return fill_row_scalar<T, N>;
+}
+
+
+template <typename T>
+static fill_row_fn select_fill_kernel(simd_level simd, uint32_t numComps) {
+    switch (numComps) {
+        case 1:
+            return select_fill_kernel<T, 1>(simd);
+        case 3:
+            return select_fill_kernel<T, 3>(simd);
+        case 4:
+            return select_fill_kernel<T, 4>(simd);
+        default:
+            return fill_row_scalar<T, 0>;
+    }
+}
+
+
+fill_row_fn get_fill_kernel(uint32_t typesize, uint32_t numComps, bool sgnd) {
+    simd_level simd = get_simd_level();
+    switch (typesize) {
+        case 1:
+            return sgnd ? select_fill_kernel<int8_t>(simd, numComps) : select_fill_kernel<uint8_t>(simd, numComps);
+        case 2:
+            return sgnd ? select_fill_kernel<int16_t>(simd, numComps) : select_fill_kernel<uint16_t>(simd, numComps);
+        case 4:
+            return sgnd ? fill_row_scalar<int32_t, 0> : fill_row_scalar<uint32_t, 0>;
+        default:
+            return nullptr;
+    }
+}
+
+
+// Plain loop: compilers vectorize this reduction well at any SIMD level
+template <typename T>
+static uint32_t or_row(const uint8_t *src, size_t nsamples) {
+    using U = std::make_unsigned_t<T>;
+    U acc = 0;
+    for (size_t i = 0; i < nsamples; ++i) {
+        T v;
+        memcpy(&v, src + i * sizeof(T), sizeof(T));
+        if constexpr (std::is_signed_v<T>) {
+            // ~v for negative samples: the bits needed besides the sign bit
+            acc |= (U)(v ^ (v >> (8 * sizeof(T) - 1)));
+        } else {
+            acc |= v;
+        }
+    }
+    return (uint32_t)acc;
+}
+
+
+or_row_fn get_or_kernel(uint32_t typesize, bool sgnd) {
+    switch (typesize) {
+        case 1:
+            return sgnd ? or_row<int8_t> : or_row<uint8_t>;
+        case 2:
+            return sgnd ? or_row<int16_t> : or_row<uint16_t>;
+        case 4:
+            return sgnd ? or_row<int32_t> : or_row<uint32_t>;
+        default:
+            return nullptr;
+    }
+}
+
+
+// Plain loops as well: the per-sample work is enough for the compiler to do a good job
+bool minmax_float(const uint8_t *src, size_t nsamples, float *vmin, float *vmax) {
+    float lo = std::numeric_limits<float>::infinity();
+    float hi = -lo;
+    float nonfinite = 0;
+    for (size_t i = 0; i < nsamples; ++i) {
+        float v;
+        memcpy(&v, src + i * sizeof(float), sizeof(float));
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+        // NaN for infinities and NaNs
+        nonfinite += v - v;
+    }
+    *vmin = lo;
+    *vmax = hi;
+    return nonfinite == 0;
+}
+
+
+void quantize_row(const uint8_t *src, int32_t *const *dst, uint32_t npixels, uint32_t numComps,
+                  double offset, double step) {
+    const double scale = 1 / step;
+    for (uint32_t i = 0; i < npixels; ++i) {
+        for (uint32_t c = 0; c < numComps; ++c) {
+            float v;
+            memcpy(&v, src, sizeof(float));
+            src += sizeof(float);
+            dst[c][i] = (int32_t)std::floor((v - offset) * scale + 0.5);
+        }
+    }
+}
+
+
+void dequantize_row(const int32_t *const *src, uint8_t *dst, uint32_t npixels, uint32_t numComps,
+                    double offset, double step) {
+    for (uint32_t i = 0; i < npixels; ++i) {
+        for (uint32_t c = 0; c < numComps; ++c) {
+            float v = (float)(offset + src[c][i] * step);
+            memcpy(dst, &v, sizeof(float));
+            dst += sizeof(float);
+        }
+    }
+}
+
+
+void scale_row(const int32_t *__restrict src, int32_t *__restrict dst, size_t nsamples, double step) {
+    const double scale = 1 / step;
+    for (size_t i = 0; i < nsamples; ++i) {
+        dst[i] = (int32_t)std::floor(src[i] * scale + 0.5);
+    }
+}
+
+
+void unscale_row(int32_t *row, size_t nsamples, double step) {
+    for (size_t i = 0; i < nsamples; ++i) {
+        row[i] = (int32_t)std::floor(row[i] * step + 0.5);
+    }
+}
+
+
+bool is_periodic(const uint8_t *src, size_t len, size_t unit) {
+    // Every byte equals the one a unit further (memcmp is vectorized by libc)
+    return unit > 0 && len % unit == 0 && (len == unit || memcmp(src, src + unit, len - unit) == 0);
+}
+
+
+void fill_pattern(uint8_t *dst, size_t len, const uint8_t *pattern, size_t unit) {
+    if (unit == 1) {
+        memset(dst, pattern[0], len);
+        return;
+    }
+    // Double the filled part at every step, so that memcpy does the work with wide copies
+    size_t done = std::min(unit, len);
+    memcpy(dst, pattern, done);
+    while (done < len) {
+        const size_t n = std::min(done, len - done);
+        memcpy(dst + done, dst, n);
+        done += n;
+    }
+}
+
+
+void split_row(const uint8_t *src, int32_t *const *dst, uint32_t npixels, uint32_t numComps, bool sgnd) {
+    for (uint32_t i = 0; i < npixels; ++i) {
+        for (uint32_t c = 0; c < numComps; ++c) {
+            uint32_t v;
+            memcpy(&v, src, sizeof(v));
+            src += sizeof(v);
+            dst[c][i] = sgnd ? (int32_t)v >> 16 : (int32_t)(v >> 16);
+            dst[numComps + c][i] = (int32_t)(v & 0xFFFF);
+        }
+    }
+}
+
+
+void join_row(const int32_t *const *src, uint8_t *dst, uint32_t npixels, uint32_t numComps, bool sgnd) {
+    const int32_t himin = sgnd ? INT16_MIN : 0;
+    const int32_t himax = sgnd ? INT16_MAX : UINT16_MAX;
+    for (uint32_t i = 0; i < npixels; ++i) {
+        for (uint32_t c = 0; c < numComps; ++c) {
+            int32_t hi = std::clamp(src[c][i], himin, himax);
+            int32_t lo = std::clamp(src[numComps + c][i], 0, (int32_t)UINT16_MAX);
+            uint32_t v = ((uint32_t)hi << 16) | (uint32_t)lo;
+            memcpy(dst, &v, sizeof(v));
+            dst += sizeof(v);
+        }
+    }
+}
+
+
+// Lifting steps of the 5/3 wavelet between component rows.  Rows never alias
+// the one being updated (the neighbours `a` and `b` may be the same row at the
+// edges), so these plain loops vectorize.
+static void predict_row(int32_t *__restrict d, const int32_t *__restrict a, const int32_t *__restrict b,
+                        uint32_t npixels) {
+    for (uint32_t i = 0; i < npixels; ++i) {
+        d[i] -= (a[i] + b[i]) >> 1;
+    }
+}
+
+static void unpredict_row(int32_t *__restrict d, const int32_t *__restrict a, const int32_t *__restrict b,
+                          uint32_t npixels) {
+    for (uint32_t i = 0; i < npixels; ++i) {
+        d[i] += (a[i] + b[i]) >> 1;
+    }
+}
+
+static void update_row(int32_t *__restrict s, const int32_t *__restrict a, const int32_t *__restrict b,
+                       uint32_t npixels) {
+    for (uint32_t i = 0; i < npixels; ++i) {
+        s[i] += (a[i] + b[i] + 2) >> 2;
+    }
+}
+
+static void unupdate_row(int32_t *__restrict s, const int32_t *__restrict a, const int32_t *__restrict b,
+                         uint32_t npixels) {
+    for (uint32_t i = 0; i < npixels; ++i) {
+        s[i] -= (a[i] + b[i] + 2) >> 2;
+    }
+}
+
+// Residual against (and reconstruction from) the previous frame
+static void delta_row(int32_t *__restrict d, const int32_t *__restrict prev, uint32_t npixels) {
+    for (uint32_t i = 0; i < npixels; ++i) {
+        d[i] -= prev[i];
+    }
+}
+
+static void undelta_row(int32_t *__restrict d, const int32_t *__restrict prev, uint32_t npixels) {
+    for (uint32_t i = 0; i < npixels; ++i) {
+        d[i] += prev[i];
+    }
+}
+
+
+// At level l, the signal is made of the components at multiples of 2^l, and
+// its odd samples (the highpass ones) are neighboured by even ones, mirrored
+// at the ends.
+void spectral_forward(int32_t *const *rows, uint32_t numComps, uint32_t npixels, uint32_t levels) {
+    for (uint32_t l = 0; l < levels; ++l) {
+        const uint32_t step = 1u << l;
+        const uint32_t n = (numComps + step - 1) / step;
+        if (n < 2) {
+            break;
+        }
+        for (uint32_t k = 1; k < n; k += 2) {
+            const uint32_t next = k + 1 < n ? k + 1 : k - 1;
+            predict_row(rows[k * step], rows[(k - 1) * step], rows[next * step], npixels);
+        }
+        for (uint32_t k = 0; k < n; k += 2) {
+            const uint32_t prev = k > 0 ? k - 1 : 1;
+            const uint32_t next = k + 1 < n ? k + 1 : prev;
+            update_row(rows[k * step], rows[prev * step], rows[next * step], npixels);
+        }
+    }
+}
+
+
+void spectral_inverse(int32_t *const *rows, uint32_t numComps, uint32_t npixels, uint32_t levels) {
+    for (uint32_t l = levels; l-- > 0;) {
+        const uint32_t step = 1u << l;
+        const uint32_t n = (numComps + step - 1) / step;
+        if (n < 2) {
+            continue;
+        }
+        for (uint32_t k = 0; k < n; k += 2) {
+            const uint32_t prev = k > 0 ? k - 1 : 1;
+            const uint32_t next = k + 1 < n ? k + 1 : prev;
+            unupdate_row(rows[k * step], rows[prev * step], rows[next * step], npixels);
+        }
+        for (uint32_t k = 1; k < n; k += 2) {
+            const uint32_t next = k + 1 < n ? k + 1 : k - 1;
+            unpredict_row(rows[k * step], rows[(k - 1) * step], rows[next * step], npixels);
+        }
+    }
+}
+
+
+// Frames are predicted from the original previous frame, so the residuals are
+// taken from the last frame backwards, and reconstructed from the first one on
+void temporal_forward(int32_t *const *rows, uint32_t numComps, uint32_t npixels, uint32_t nframes) {
+    const uint32_t n = numComps / nframes;
+    for (uint32_t k = numComps; k-- > n;) {
+        delta_row(rows[k], rows[k - n], npixels);
+    }
+}
+
+
+void temporal_inverse(int32_t *const *rows, uint32_t numComps, uint32_t npixels, uint32_t nframes) {
+    const uint32_t n = numComps / nframes;
+    for (uint32_t k = n; k < numComps; ++k) {
+        undelta_row(rows[k], rows[k - n], npixels);
+    }
+}
+
+
+template <typename T, uint32_t N>
+static store_row_fn select_store_kernel(simd_level simd) {
+#if defined(KERNELS_X86)
+    if (simd == SIMD_AVX2) {
+        if constexpr (N == 1) return store_row_c1_avx2<T>;
+    }
+    if (simd >= SIMD_SSE41) {
+        if constexpr (N == 1) return store_row_c1_sse41<T>;
+        if constexpr (N == 3) return store_row_c3_sse41<T>;
+        if constexpr (N == 4 && std::is_same_v<T, uint8_t>) return store_row_u8c4_sse41;
+        if constexpr (N == 4 && std::is_same_v<T, uint16_t>) return store_row_u16c4_sse41;
+    }
+#elif defined(KERNELS_NEON)
+    if (simd == SIMD_NEON) {
+        return store_row_neon<T, N>;
+    }
+#endif
+    (void)simd;
+    return store_row_scalar<T, N>;
+}
+
+
+template <typename T>
+static store_row_fn select_store_kernel(simd_level simd, uint32_t numComps) {
+    switch (numComps) {
+        case 1:
+            return select_store_kernel<T, 1>(simd);
+        case 3:
+            return select_store_kernel<T, 3>(simd);
+        case 4:
+            return select_store_kernel<T, 4>(simd);
+        default:
+            return store_row_scalar<T, 0>;
+    }
+}
+
+
+store_row_fn get_store_kernel(uint32_t typesize, uint32_t numComps, bool sgnd) {
+    simd_level simd = get_simd_level();
+    switch (typesize) {
+        case 1:
+            return sgnd ? select_store_kernel<int8_t>(simd, numComps) : select_store_kernel<uint8_t>(simd, numComps);
+        case 2:
+            return sgnd ? select_store_kernel<int16_t>(simd, numComps) : select_store_kernel<uint16_t>(simd, numComps);
+        case 4:
+            return sgnd ? store_row_scalar<int32_t, 0> : store_row_scalar<uint32_t, 0>;
+        default:
+            return nullptr;
+    }
+}
@@ -0,0 +1,93 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#ifndef BLOSC2_GROK_KERNELS_H
+#define BLOSC2_GROK_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Deinterleave `npixels` pixels of `numComps` samples each from `src` and widen
+// them into one int32 row per component (`dst[compno]`).  Samples are read in
+// native byte order and sign-extended when the kernel is for signed data.
+typedef void (*fill_row_fn)(const uint8_t *src, int32_t *const *dst, uint32_t npixels, uint32_t numComps);
+
+// Return the best fill kernel for this CPU.  8/16-bit samples with 1 or 3
+// components (and unsigned ones with 4) have dedicated (SIMD) kernels;
+// anything else gets a generic one.
+fill_row_fn get_fill_kernel(uint32_t typesize, uint32_t numComps, bool sgnd);
+
+// Bitwise OR of `nsamples` samples at `src`, for finding the bit depth of the
+// data.  Negative signed samples contribute their complement, so the result
+// excludes the sign bit.  Meant to run on a row just filled, while it is in cache.
+typedef uint32_t (*or_row_fn)(const uint8_t *src, size_t nsamples);
+
+// Return the OR kernel for samples of `typesize` bytes (null if unsupported)
+or_row_fn get_or_kernel(uint32_t typesize, bool sgnd);
+
+// Narrow one int32 row per component (`src[compno]`) to (un)signed samples of
+// `typesize` bytes (saturating) and interleave `npixels` pixels into `dst`.
+typedef void (*store_row_fn)(const int32_t *const *src, uint8_t *dst, uint32_t npixels, uint32_t numComps);
+
+// Return the best store kernel for this CPU (same specializations as above).
+store_row_fn get_store_kernel(uint32_t typesize, uint32_t numComps, bool sgnd);
+
+// Minimum and maximum of `nsamples` float32 samples at `src`.  Returns false
+// if any of them is not finite.
+bool minmax_float(const uint8_t *src, size_t nsamples, float *vmin, float *vmax);
+
+// Deinterleave `npixels` pixels of float32 samples as a fill kernel does,
+// quantizing them to round((v - offset) / step)
+void quantize_row(const uint8_t *src, int32_t *const *dst, uint32_t npixels, uint32_t numComps,
+                  double offset, double step);
+
+// Inverse of quantize_row: interleave offset + q * step as float32 samples
+void dequantize_row(const int32_t *const *src, uint8_t *dst, uint32_t npixels, uint32_t numComps,
+                    double offset, double step);
+
+// Quantize `nsamples` integer samples to round(v / step), and the inverse
+// (round(q * step)) in place, for blocks scaled to reach a rate in HT mode
+void scale_row(const int32_t *src, int32_t *dst, size_t nsamples, double step);
+void unscale_row(int32_t *row, size_t nsamples, double step);
+
+// Deinterleave `npixels` pixels of 32-bit samples into their high (`dst[c]`)
+// and low (`dst[numComps + c]`) 16-bit words, in one pass.  High words are
+// sign-extended for signed samples; low words are always unsigned.
+void split_row(const uint8_t *src, int32_t *const *dst, uint32_t npixels, uint32_t numComps, bool sgnd);
+
+// Inverse of split_row: join the words (saturating each of them to its
+// range) and interleave the 32-bit samples into `dst`
+void join_row(const int32_t *const *src, uint8_t *dst, uint32_t npixels, uint32_t numComps, bool sgnd);
+
+// Reversible (integer) 5/3 wavelet across the components of a pixel row, in
+// place: `rows[c]` holds `npixels` samples of component c.  Every one of the
+// `levels` dyadic levels splits the lowpass components of the previous one,
+// so the lowpass ones end up at multiples of 2^levels, and the rest hold the
+// highpass (signed) details.  spectral_inverse undoes it exactly.
+void spectral_forward(int32_t *const *rows, uint32_t numComps, uint32_t npixels, uint32_t levels);
+void spectral_inverse(int32_t *const *rows, uint32_t numComps, uint32_t npixels, uint32_t levels);
+
+// Reversible prediction of every frame from the previous one, in place: the
+// components of a pixel row come frame after frame in `rows` (numComps /
+// nframes per frame), and all but the first frame become (signed) residuals.
+// temporal_inverse undoes it exactly.
+void temporal_forward(int32_t *const *rows, uint32_t numComps, uint32_t npixels, uint32_t nframes);
+void temporal_inverse(int32_t *const *rows, uint32_t numComps, uint32_t npixels, uint32_t nframes);
+
+// Whether the `len` bytes at `src` repeat their first `unit` bytes (a block
+// of constant pixels).  It stops at the first difference, so non-constant
+// blocks cost next to nothing.
+bool is_periodic(const uint8_t *src, size_t len, size_t unit);
+
+// Fill `len` bytes at `dst` with copies of the `unit` bytes at `pattern`
+void fill_pattern(uint8_t *dst, size_t len, const uint8_t *pattern, size_t unit);
+
+// Name of the instruction set picked at runtime ("avx2", "sse4.1", "neon" or "scalar")
+const char *get_simd_name();
+
+#endif
@@ -0,0 +1,122 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include "grok.h"
+#include "blosc2_grok.h"
+#include "pool.h"
+
+// Codecs hold the pool in shared mode; resizing it needs exclusive access
+static std::shared_mutex pool_mutex;
+static std::atomic<int> sched_mode{BLOSC2_GROK_SCHED_FIXED};
+static std::atomic<uint32_t> sched_ncores{0};
+// Current pool size (0 means unknown, i.e. the next block in auto mode resizes it)
+static std::atomic<uint32_t> pool_size{0};
+// Consecutive requests for at most half the current size, before shrinking the pool
+#define SHRINK_AFTER 64
+static std::atomic<uint32_t> shrink_requests{0};
+static uint32_t fixed_nthreads = 0;
+static bool pool_verbose = false;
+
+
+// pool_mutex must be held in exclusive mode
+static void resize_pool(uint32_t nthreads) {
+    // grk_initialize does not resize an existing pool
+    grk_deinitialize();
+    grk_initialize(nullptr, nthreads, pool_verbose);
+    pool_size = nthreads;
+}
+
+
+void init_grok_pool(uint32_t nthreads, bool verbose) {
+    std::unique_lock<std::shared_mutex> lock(pool_mutex);
+    fixed_nthreads = nthreads;
+    pool_verbose = verbose;
+    if (sched_mode == BLOSC2_GROK_SCHED_FIXED) {
+        grk_initialize(nullptr, nthreads, verbose);
+    }
+}
+
+
+uint32_t grok_pool_size(uint32_t nthreads, uint32_t nblocks) {
+    uint32_t ncores = sched_ncores;
+    if (ncores == 0) {
+        ncores = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    // Blocks coded at the same time; each one gets an even share of the cores
+    uint32_t concurrent = std::max(nthreads, 1u);
+    if (nblocks != 0) {
+        concurrent = std::min(concurrent, nblocks);
+    }
+    return std::max(ncores / concurrent, 1u);
+}
+
+
+std::shared_lock<std::shared_mutex> acquire_grok_pool(uint32_t nthreads, uint32_t nblocks) {
+    if (sched_mode == BLOSC2_GROK_SCHED_AUTO) {
+        const uint32_t wanted = grok_pool_size(nthreads, nblocks);
+        const uint32_t current = pool_size;
+        bool resize = current == 0 || wanted > current;
+        if (!resize && 2 * wanted <= current) {
+            // Only shrink once the smaller size has been asked for a while
+            resize = ++shrink_requests >= SHRINK_AFTER;
+        } else if (!resize) {
+            shrink_requests = 0;
+        }
+        if (resize) {
+            // Waits for the codecs in flight to finish
+            std::unique_lock<std::shared_mutex> lock(pool_mutex);
+            // Another block may have resized it in the meantime
+            if (sched_mode == BLOSC2_GROK_SCHED_AUTO && pool_size == current) {
+                resize_pool(wanted);
+            }
+            shrink_requests = 0;
+        }
+    }
+    return std::shared_lock<std::shared_mutex>(pool_mutex);
+}
+
+
+std::shared_lock<std::shared_mutex> share_grok_pool() {
+    if (sched_mode == BLOSC2_GROK_SCHED_AUTO && pool_size == 0) {
+        // Nothing has been coded yet, so grok is not initialized: start with
+        // the whole core budget, which encoders will size to their needs
+        std::unique_lock<std::shared_mutex> lock(pool_mutex);
+        if (sched_mode == BLOSC2_GROK_SCHED_AUTO && pool_size == 0) {
+            resize_pool(grok_pool_size(1, 1));
+        }
+    }
+    return std::shared_lock<std::shared_mutex>(pool_mutex);
+}
+
+
+void reset_grok_pool() {
+    pool_size = 0;
+    shrink_requests = 0;
+}
+
+
+void blosc2_grok_set_sched_mode(int mode, uint32_t ncores) {
+    std::unique_lock<std::shared_mutex> lock(pool_mutex);
+    if (mode != BLOSC2_GROK_SCHED_FIXED && mode != BLOSC2_GROK_SCHED_AUTO) {
+        fprintf(stderr, "Unknown scheduler mode %d\n", mode);
+        return;
+    }
+    sched_ncores = ncores;
+    if (mode == BLOSC2_GROK_SCHED_FIXED && sched_mode == BLOSC2_GROK_SCHED_AUTO) {
+        // Go back to the pool size given by the user
+        resize_pool(fixed_nthreads);
+    }
+    pool_size = 0;
+    sched_mode = mode;
+}
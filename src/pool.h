@@ -0,0 +1,45 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#ifndef BLOSC2_GROK_POOL_H
+#define BLOSC2_GROK_POOL_H
+
+#include <cstdint>
+#include <shared_mutex>
+
+// Grok runs the tile/codeblock work of every codec on a single work-stealing
+// pool, shared by all the blosc2 threads that compress blocks at the same time.
+// In fixed mode the size of that pool is the one given by the user (see
+// blosc2_grok_init and 'num_threads'); in auto mode it is derived from the
+// blosc2 thread count and the number of blocks per chunk, so that block-level
+// and grok-level parallelism together use the core budget without oversubscribing.
+
+// (Re)initialize grok with a user-given thread count and verbosity.  In auto
+// mode the count is only recorded, and the pool is sized on the next block.
+void init_grok_pool(uint32_t nthreads, bool verbose);
+
+// Acquire the grok pool for the lifetime of an encoder, resizing it first if
+// needed in auto mode.  `nthreads` is the blosc2 thread count and `nblocks`
+// the number of blocks in the chunk (0 if unknown).  Resizing stalls every
+// codec, so the pool grows right away but only shrinks (to at most half its
+// size) after many consecutive requests for the smaller size.
+std::shared_lock<std::shared_mutex> acquire_grok_pool(uint32_t nthreads, uint32_t nblocks);
+
+// Acquire the grok pool for the lifetime of a decoder, as it is: decoding
+// never resizes it, so that reads interleaved with writes do not rebuild it.
+// In auto mode, a decoder that comes before any encoder initializes it with
+// the whole core budget.
+std::shared_lock<std::shared_mutex> share_grok_pool();
+
+// Pool size auto mode would pick for this combination
+uint32_t grok_pool_size(uint32_t nthreads, uint32_t nblocks);
+
+// Forget the current pool size (grok has been deinitialized)
+void reset_grok_pool();
+
+#endif
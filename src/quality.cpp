@@ -0,0 +1,234 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+
+#include "blosc2_grok.h"
+#include "kernels.h"
+#include "quality.h"
+
+#define SSIM_WINDOW 8
+
+static std::mutex stats_mutex;
+static blosc2_grok_quality_stats stats = {};
+
+// Per-thread rate of the last block, and the super-chunk it belongs to.
+// Blocks of the same array are coded one after the other by each thread, so
+// a single entry is enough.
+static thread_local const blosc2_schunk *rate_schunk = nullptr;
+static thread_local double start_rate = 0;
+// Per-thread rate correction of the last block coded to a target rate, and
+// the settings it was coded with
+static thread_local rate_settings correction_settings = {};
+static thread_local double rate_correction = 1;
+// ... and for the quantization step of HT blocks coded to a target rate
+static thread_local const blosc2_schunk *step_schunk = nullptr;
+static thread_local double start_step = 0;
+
+
+void copy_planes(const grk_image *image, image_planes &planes) {
+    planes.numComps = image->numcomps;
+    planes.width = image->comps[0].w;
+    planes.height = image->comps[0].h;
+    planes.data.resize((size_t)planes.numComps * planes.width * planes.height);
+    int32_t *dst = planes.data.data();
+    for (uint32_t compno = 0; compno < planes.numComps; ++compno) {
+        const grk_image_comp *comp = image->comps + compno;
+        for (uint32_t j = 0; j < planes.height; ++j) {
+            memcpy(dst, comp->data + (size_t)j * comp->stride, planes.width * sizeof(int32_t));
+            dst += planes.width;
+        }
+    }
+}
+
+
+void scale_planes(const image_planes &planes, grk_image *image, double step) {
+    const int32_t *src = planes.data.data();
+    for (uint32_t compno = 0; compno < planes.numComps; ++compno) {
+        grk_image_comp *comp = image->comps + compno;
+        for (uint32_t j = 0; j < planes.height; ++j) {
+            scale_row(src, comp->data + (size_t)j * comp->stride, planes.width, step);
+            src += planes.width;
+        }
+    }
+}
+
+
+// Plain loops, as for the other reductions: compilers vectorize them well
+static int64_t squared_error_row(const int32_t *a, const int32_t *b, uint32_t npixels) {
+    int64_t acc = 0;
+    for (uint32_t i = 0; i < npixels; ++i) {
+        const int64_t d = (int64_t)a[i] - b[i];
+        acc += d * d;
+    }
+    return acc;
+}
+
+
+// Column sums over the rows of a band of windows
+struct window_sums {
+    std::vector<double> x, y, xx, yy, xy;
+};
+
+static void accumulate_row(const int32_t *__restrict a, const int32_t *__restrict b, uint32_t npixels,
+                           window_sums &s) {
+    double *__restrict x = s.x.data();
+    double *__restrict y = s.y.data();
+    double *__restrict xx = s.xx.data();
+    double *__restrict yy = s.yy.data();
+    double *__restrict xy = s.xy.data();
+    for (uint32_t i = 0; i < npixels; ++i) {
+        const double va = a[i];
+        const double vb = b[i];
+        x[i] += va;
+        y[i] += vb;
+        xx[i] += va * va;
+        yy[i] += vb * vb;
+        xy[i] += va * vb;
+    }
+}
+
+
+// Sum of the SSIM of the windows of a component, and their number
+static double ssim_plane(const int32_t *orig, const grk_image_comp *comp, uint32_t width, uint32_t height,
+                         double peak, uint64_t *nwindows) {
+    // Images smaller than a window are a single window
+    const uint32_t wx = std::min(width, (uint32_t)SSIM_WINDOW);
+    const uint32_t wy = std::min(height, (uint32_t)SSIM_WINDOW);
+    const double n = (double)wx * wy;
+    const double c1 = (0.01 * peak) * (0.01 * peak);
+    const double c2 = (0.03 * peak) * (0.03 * peak);
+    window_sums s;
+    double sum = 0;
+    for (uint32_t y0 = 0; y0 + wy <= height; y0 += wy) {
+        for (auto *v : {&s.x, &s.y, &s.xx, &s.yy, &s.xy}) {
+            v->assign(width, 0.);
+        }
+        for (uint32_t j = y0; j < y0 + wy; ++j) {
+            accumulate_row(orig + (size_t)j * width, comp->data + (size_t)j * comp->stride, width, s);
+        }
+        for (uint32_t x0 = 0; x0 + wx <= width; x0 += wx) {
+            double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+            for (uint32_t i = x0; i < x0 + wx; ++i) {
+                sx += s.x[i];
+                sy += s.y[i];
+                sxx += s.xx[i];
+                syy += s.yy[i];
+                sxy += s.xy[i];
+            }
+            const double mx = sx / n;
+            const double my = sy / n;
+            const double vx = sxx / n - mx * mx;
+            const double vy = syy / n - my * my;
+            const double cxy = sxy / n - mx * my;
+            sum += (2 * mx * my + c1) * (2 * cxy + c2) / ((mx * mx + my * my + c1) * (vx + vy + c2));
+            (*nwindows)++;
+        }
+    }
+    return sum;
+}
+
+
+bool measure_quality(const image_planes &orig, const grk_image *decoded, uint32_t prec, image_quality &quality) {
+    quality = {0, 0};
+    if (decoded->numcomps != orig.numComps) {
+        return false;
+    }
+    for (uint32_t compno = 0; compno < orig.numComps; ++compno) {
+        const grk_image_comp *comp = decoded->comps + compno;
+        if (comp->w != orig.width || comp->h != orig.height || comp->data == nullptr) {
+            return false;
+        }
+    }
+    const double peak = std::ldexp(1.0, (int)prec) - 1;
+    const size_t plane = (size_t)orig.width * orig.height;
+    int64_t sse = 0;
+    double ssim = 0;
+    uint64_t nwindows = 0;
+    for (uint32_t compno = 0; compno < orig.numComps; ++compno) {
+        const int32_t *src = orig.data.data() + compno * plane;
+        const grk_image_comp *comp = decoded->comps + compno;
+        for (uint32_t j = 0; j < orig.height; ++j) {
+            sse += squared_error_row(src + (size_t)j * orig.width, comp->data + (size_t)j * comp->stride,
+                                     orig.width);
+        }
+        ssim += ssim_plane(src, comp, orig.width, orig.height, peak, &nwindows);
+    }
+    const double mse = (double)sse / ((double)plane * orig.numComps);
+    quality.psnr = mse == 0 ? std::numeric_limits<double>::infinity() : 10 * std::log10(peak * peak / mse);
+    quality.ssim = nwindows > 0 ? ssim / (double)nwindows : 1;
+    return true;
+}
+
+
+double get_start_rate(const blosc2_schunk *schunk) {
+    return rate_schunk == schunk ? start_rate : 0;
+}
+
+
+void set_start_rate(const blosc2_schunk *schunk, double rate) {
+    rate_schunk = schunk;
+    start_rate = rate;
+}
+
+
+double get_rate_correction(const rate_settings &settings) {
+    return correction_settings == settings ? rate_correction : 1;
+}
+
+
+void set_rate_correction(const rate_settings &settings, double correction) {
+    correction_settings = settings;
+    rate_correction = correction;
+}
+
+
+double get_start_step(const blosc2_schunk *schunk) {
+    return step_schunk == schunk ? start_step : 0;
+}
+
+
+void set_start_step(const blosc2_schunk *schunk, double step) {
+    step_schunk = schunk;
+    start_step = step;
+}
+
+
+void record_quality(const image_quality &quality, uint32_t passes) {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    if (stats.blocks == 0 || quality.psnr < stats.min_psnr) {
+        stats.min_psnr = quality.psnr;
+    }
+    if (stats.blocks == 0 || quality.ssim < stats.min_ssim) {
+        stats.min_ssim = quality.ssim;
+    }
+    stats.blocks++;
+    stats.passes += passes;
+    // Identical blocks (an infinite PSNR) do not count for the mean
+    if (std::isfinite(quality.psnr)) {
+        stats.psnr_blocks++;
+        stats.sum_psnr += quality.psnr;
+    }
+    stats.sum_ssim += quality.ssim;
+}
+
+
+void blosc2_grok_get_quality_stats(blosc2_grok_quality_stats *out) {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    *out = stats;
+}
+
+
+void blosc2_grok_reset_quality_stats() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats = {};
+}
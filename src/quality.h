@@ -0,0 +1,77 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#ifndef BLOSC2_GROK_QUALITY_H
+#define BLOSC2_GROK_QUALITY_H
+
+#include <cstdint>
+#include <vector>
+
+#include "blosc2.h"
+#include "grok.h"
+
+// Quality of decoded images, for coding blocks to a target PSNR or SSIM.
+// Metrics are computed on the image planes (after deinterleaving), with a
+// peak value of 2^prec - 1 for samples of `prec` bits.  SSIM is the mean of
+// the SSIM of every (non-overlapping) 8 x 8 window of every component.
+
+// Packed copy of the planes of an image, as it was before coding
+struct image_planes {
+    uint32_t numComps;
+    uint32_t width;
+    uint32_t height;
+    std::vector<int32_t> data;
+};
+
+void copy_planes(const grk_image *image, image_planes &planes);
+
+// Write the `planes` back into `image`, quantized to round(v / step)
+void scale_planes(const image_planes &planes, grk_image *image, double step);
+
+struct image_quality {
+    double psnr;    // +inf for identical images
+    double ssim;
+};
+
+// Quality of `decoded` against the original `planes`.  Returns false if the
+// geometry of the images does not match.
+bool measure_quality(const image_planes &orig, const grk_image *decoded, uint32_t prec, image_quality &quality);
+
+// Rate that the last block of `schunk` coded in this thread ended up with,
+// as a starting point for the next one (0 if there is none)
+double get_start_rate(const blosc2_schunk *schunk);
+void set_start_rate(const blosc2_schunk *schunk, double rate);
+
+// Settings that rate corrections are kept for.  Blocks coded with the same
+// ones land about as far from their rate, whatever array they belong to, so
+// this does not depend on addresses that may be reused.
+struct rate_settings {
+    double rate;
+    uint32_t width;
+    uint32_t height;
+    uint32_t numcomps;
+    uint32_t prec;
+
+    bool operator==(const rate_settings &other) const = default;
+};
+
+// Factor that the rates asked to grok for the last block coded with
+// `settings` in this thread had to be multiplied by to get the rate wanted
+// (1 if there is none)
+double get_rate_correction(const rate_settings &settings);
+void set_rate_correction(const rate_settings &settings, double correction);
+
+// Quantization step that the last HT block of `schunk` coded in this thread
+// needed to reach its rate (0 if there is none)
+double get_start_step(const blosc2_schunk *schunk);
+void set_start_step(const blosc2_schunk *schunk, double step);
+
+// Account a block coded to a target quality in `passes` encode and decode passes
+void record_quality(const image_quality &quality, uint32_t passes);
+
+#endif
@@ -0,0 +1,162 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "blosc2.h"
+#include "tag.h"
+
+#define TAG_HEADER_LEN 6
+
+
+static inline void put_u16(uint8_t *&p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p += 2;
+}
+
+static inline void put_f64(uint8_t *&p, double v) {
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    for (int i = 0; i < 8; ++i) {
+        p[i] = (uint8_t)(u >> (8 * i));
+    }
+    p += 8;
+}
+
+static inline uint16_t get_u16(const uint8_t *&p) {
+    uint16_t v = (uint16_t)(p[0] | (p[1] << 8));
+    p += 2;
+    return v;
+}
+
+static inline double get_f64(const uint8_t *&p) {
+    uint64_t u = 0;
+    for (int i = 0; i < 8; ++i) {
+        u |= (uint64_t)p[i] << (8 * i);
+    }
+    p += 8;
+    double v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+
+size_t get_tag_size(const block_tag &tag) {
+    size_t size = TAG_HEADER_LEN;
+    if (tag.flags & GROK_TAG_FLOAT) {
+        size += 16;
+    }
+    if (tag.flags & GROK_TAG_SPECTRAL) {
+        size += 2;
+    }
+    if (tag.flags & GROK_TAG_STACK) {
+        size += 2;
+    }
+    if (tag.flags & GROK_TAG_TEMPORAL) {
+        size += 1;
+    }
+    if (tag.flags & GROK_TAG_SCALED) {
+        size += 8;
+    }
+    if (tag.flags & GROK_TAG_CONST) {
+        size += 2 + tag.fill_len;
+    }
+    return size;
+}
+
+
+void write_tag(const block_tag &tag, uint8_t *dest) {
+    uint8_t *p = dest;
+    *p++ = GROK_TAG_MAGIC;
+    *p++ = GROK_TAG_VERSION;
+    put_u16(p, (uint16_t)get_tag_size(tag));
+    put_u16(p, tag.flags);
+    if (tag.flags & GROK_TAG_FLOAT) {
+        put_f64(p, tag.offset);
+        put_f64(p, tag.step);
+    }
+    if (tag.flags & GROK_TAG_SPECTRAL) {
+        *p++ = tag.levels;
+        *p++ = tag.sgnd;
+    }
+    if (tag.flags & GROK_TAG_STACK) {
+        put_u16(p, tag.frames);
+    }
+    if (tag.flags & GROK_TAG_TEMPORAL) {
+        *p++ = tag.sgnd;
+    }
+    if (tag.flags & GROK_TAG_SCALED) {
+        put_f64(p, tag.scale);
+    }
+    if (tag.flags & GROK_TAG_CONST) {
+        put_u16(p, tag.fill_len);
+        memcpy(p, tag.fill, tag.fill_len);
+    }
+}
+
+
+int read_tag(const uint8_t *block, size_t len, block_tag &tag) {
+    tag = block_tag{};
+    if (len == 0 || block[0] != GROK_TAG_MAGIC) {
+        return 0;
+    }
+    if (len < TAG_HEADER_LEN || block[1] != GROK_TAG_VERSION) {
+        fprintf(stderr, "Unsupported block tag\n");
+        return BLOSC2_ERROR_INVALID_HEADER;
+    }
+    const uint8_t *p = block + 2;
+    const uint16_t taglen = get_u16(p);
+    tag.flags = get_u16(p);
+    // The pixel of constant blocks (and its length) comes last
+    if (tag.flags & GROK_TAG_CONST) {
+        const size_t fixed = get_tag_size(tag);
+        if (taglen > len || taglen < fixed) {
+            fprintf(stderr, "Invalid block tag\n");
+            return BLOSC2_ERROR_INVALID_HEADER;
+        }
+        const uint8_t *q = block + fixed - 2;
+        tag.fill_len = get_u16(q);
+        if (tag.fill_len == 0 || tag.fill_len > GROK_TAG_MAX_FILL) {
+            fprintf(stderr, "Invalid pixel in block tag\n");
+            return BLOSC2_ERROR_INVALID_HEADER;
+        }
+    }
+    if (taglen > len || taglen != get_tag_size(tag)) {
+        fprintf(stderr, "Invalid block tag\n");
+        return BLOSC2_ERROR_INVALID_HEADER;
+    }
+    if (tag.flags & GROK_TAG_FLOAT) {
+        tag.offset = get_f64(p);
+        tag.step = get_f64(p);
+    }
+    if (tag.flags & GROK_TAG_SPECTRAL) {
+        tag.levels = *p++;
+        tag.sgnd = *p++ != 0;
+    }
+    if (tag.flags & GROK_TAG_STACK) {
+        tag.frames = get_u16(p);
+    }
+    if (tag.flags & GROK_TAG_TEMPORAL) {
+        tag.sgnd = *p++ != 0;
+    }
+    if (tag.flags & GROK_TAG_SCALED) {
+        tag.scale = get_f64(p);
+        if (!(tag.scale >= 1 && std::isfinite(tag.scale))) {
+            fprintf(stderr, "Invalid scale in block tag\n");
+            return BLOSC2_ERROR_INVALID_HEADER;
+        }
+    }
+    if (tag.flags & GROK_TAG_CONST) {
+        p += 2;
+        memcpy(tag.fill, p, tag.fill_len);
+    }
+    return taglen;
+}
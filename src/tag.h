@@ -0,0 +1,68 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#ifndef BLOSC2_GROK_TAG_H
+#define BLOSC2_GROK_TAG_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Blocks whose samples are transformed before coding start with a tag that
+// tells the decoder how to undo it, followed by the codestream (whole or
+// headerless).  Codestreams start with a JP2 box length (0x00) or a marker
+// (0xFF), so the first byte tells tagged blocks apart:
+//
+//   'G' | version | tag length (uint16) | flags (uint16) | fields of the flags set, in flag order
+//
+// Multi-byte values are little endian.
+#define GROK_TAG_MAGIC 0x47
+#define GROK_TAG_VERSION 1
+// Longest pixel of a constant block
+#define GROK_TAG_MAX_FILL 256
+
+enum {
+    GROK_TAG_FLOAT = 0x1,   // float32 samples quantized as offset + q * step
+    GROK_TAG_SPLIT32 = 0x2, // 32-bit samples coded as a high and a low word component each
+    GROK_TAG_PLANAR = 0x4,  // components stored as planes (C, H, W) instead of interleaved
+    GROK_TAG_SPECTRAL = 0x8,  // 5/3 wavelet across the components (see spectral_forward)
+    GROK_TAG_STACK = 0x10,    // a stack of frames (S, H, W, C), each frame a group of components
+    GROK_TAG_TEMPORAL = 0x20, // frames predicted from the previous one (see temporal_forward)
+    GROK_TAG_SCALED = 0x40,   // samples coded as round(v / scale), to reach a rate in HT mode
+    GROK_TAG_CONST = 0x80,    // no codestream: the block repeats the pixel in the tag
+};
+
+struct block_tag {
+    uint16_t flags;
+    // GROK_TAG_FLOAT
+    double offset;
+    double step;
+    // GROK_TAG_SPECTRAL
+    uint8_t levels;
+    bool sgnd;      // the samples before the transform (the coded ones are always signed)
+    // GROK_TAG_STACK
+    uint16_t frames;
+    // GROK_TAG_TEMPORAL: sgnd, as for GROK_TAG_SPECTRAL
+    // GROK_TAG_SCALED
+    double scale;
+    // GROK_TAG_CONST
+    uint16_t fill_len;
+    uint8_t fill[GROK_TAG_MAX_FILL];
+};
+
+// Size of `tag` once written
+size_t get_tag_size(const block_tag &tag);
+
+// Write `tag` at `dest` (get_tag_size bytes)
+void write_tag(const block_tag &tag, uint8_t *dest);
+
+// Read the tag at the start of `block`.  Returns the length of the tag (0 if
+// the block has none, and then `tag` is all zeros) or a negative
+// BLOSC2_ERROR_* code if it is not valid.
+int read_tag(const uint8_t *block, size_t len, block_tag &tag);
+
+#endif
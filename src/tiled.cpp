@@ -0,0 +1,102 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include "blosc2_grok.h"
+#include "tiled.h"
+
+// Entries are keyed by the address of the chunk being compressed, and dropped
+// once every block of the chunk has been emitted.  Blocks of other chunks may
+// still be on their way, so only entries that failed (and whose remaining
+// blocks blosc2 may never code) are evicted to make room; when none did, new
+// chunks are coded block by block.
+#define MAX_TILED_CHUNKS 8
+
+static std::mutex chunks_mutex;
+static std::unordered_map<const void *, std::shared_ptr<tiled_chunk>> chunks;
+
+static std::atomic<uint64_t> nchunks{0};
+static std::atomic<uint64_t> unplaced{0};
+static std::atomic<uint64_t> evictions{0};
+
+
+std::shared_ptr<tiled_chunk> get_tiled_chunk(const void *chunk, uint32_t nblocks) {
+    std::lock_guard<std::mutex> lock(chunks_mutex);
+    auto it = chunks.find(chunk);
+    if (it != chunks.end() && it->second->hashes.size() == nblocks) {
+        return it->second;
+    }
+    if (chunks.size() >= MAX_TILED_CHUNKS && it == chunks.end()) {
+        it = std::find_if(chunks.begin(), chunks.end(), [](const auto &item) { return item.second->failed.load(); });
+        if (it == chunks.end()) {
+            unplaced.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        chunks.erase(it);
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    nchunks.fetch_add(1, std::memory_order_relaxed);
+    auto entry = std::make_shared<tiled_chunk>();
+    entry->hashes.assign(nblocks, 0);
+    entry->pending = nblocks;
+    chunks[chunk] = entry;
+    return entry;
+}
+
+
+void release_tiled_chunk(const void *chunk, const std::shared_ptr<tiled_chunk> &entry) {
+    if (--entry->pending == 0) {
+        std::lock_guard<std::mutex> lock(chunks_mutex);
+        auto it = chunks.find(chunk);
+        if (it != chunks.end() && it->second == entry) {
+            chunks.erase(it);
+        }
+    }
+}
+
+
+uint64_t hash_block(const uint8_t *data, size_t len) {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        h = (h ^ v) * prime;
+        h ^= h >> 29;
+    }
+    for (; i < len; ++i) {
+        h = (h ^ data[i]) * prime;
+    }
+    return h;
+}
+
+
+void clear_tiled_chunks() {
+    std::lock_guard<std::mutex> lock(chunks_mutex);
+    chunks.clear();
+}
+
+
+void blosc2_grok_get_tiled_stats(blosc2_grok_tiled_stats *stats) {
+    stats->chunks = nchunks.load(std::memory_order_relaxed);
+    stats->unplaced = unplaced.load(std::memory_order_relaxed);
+    stats->evictions = evictions.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(chunks_mutex);
+    stats->in_flight = chunks.size();
+}
+
+
+void blosc2_grok_reset_tiled_stats() {
+    nchunks = 0;
+    unplaced = 0;
+    evictions = 0;
+}
@@ -0,0 +1,50 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#ifndef BLOSC2_GROK_TILED_H
+#define BLOSC2_GROK_TILED_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "codestream.h"
+
+// In tiled chunk mode the whole chunk is coded as a single codestream with
+// one tile per block, by the first of its blocks that reaches the encoder.
+// Every block then emits the tile-parts of its own tile.  The other blocks
+// wait for it, so the chunk only gets the parallelism of grok itself.
+struct tiled_chunk {
+    std::mutex mutex;               // held while coding the chunk
+    bool encoded = false;
+    int rc = 0;                     // result of coding the chunk (<= 0 if no tiles)
+    std::vector<uint64_t> hashes;   // of the input of every block, to detect a reused chunk buffer
+    std::vector<std::vector<uint8_t>> tiles;
+    std::vector<uint8_t> header;    // main header, without TLM
+    bool shared;                    // header is the one stored in vlmeta
+    std::atomic<uint32_t> pending;  // blocks not emitted yet
+    std::atomic<bool> failed{false};  // a block was not emitted, so blosc2 may not ask for the others
+};
+
+// Get the entry of the chunk at `chunk` (creating it if needed), or nullptr
+// if there are too many chunks in flight.  Reusing an entry is up to the
+// caller to check against the hashes of the blocks.
+std::shared_ptr<tiled_chunk> get_tiled_chunk(const void *chunk, uint32_t nblocks);
+
+// A block of the chunk has been emitted; the entry is dropped after the last one
+void release_tiled_chunk(const void *chunk, const std::shared_ptr<tiled_chunk> &entry);
+
+// Fast (non cryptographic) hash of a block
+uint64_t hash_block(const uint8_t *data, size_t len);
+
+// Drop every entry.
+void clear_tiled_chunks();
+
+#endif
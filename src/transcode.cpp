@@ -0,0 +1,378 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#include <algorithm>
+#include <cstring>
+
+#include "blosc2.h"
+#include "grok.h"
+#include "codestream.h"
+#include "transcode.h"
+
+// JP2 box types
+#define JP2_JP   0x6A502020
+#define JP2_JP2C 0x6A703263
+
+// A PLT segment holds at most this many bytes of packet lengths
+#define MAX_PLT_DATA (UINT16_MAX - 3)
+
+struct tile_part {
+    std::vector<uint8_t> header;    // SOT payload after Psot, and segments other than PLT
+    std::vector<uint32_t> packets;  // packet lengths, from PLT
+    const uint8_t *data;            // packets (after SOD)
+};
+
+struct layered_block {
+    size_t box_start;               // offset of the jp2c box (JP2 files)
+    size_t box_header;              // length of the jp2c box header (0 for raw codestreams)
+    bool box_to_end;                // jp2c box with LBox = 0
+    std::vector<uint8_t> main;      // main header without TLM (empty for headerless blocks)
+    std::vector<tile_part> tps;
+    const uint8_t *trailer;         // from the EOC to the end of the jp2c box
+    size_t trailer_len;
+    const uint8_t *suffix;          // boxes after jp2c
+    size_t suffix_len;
+    uint16_t numlayers;
+};
+
+
+static inline uint32_t read_be16(const uint8_t *p) {
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t read_be32(const uint8_t *p) {
+    return (read_be16(p) << 16) | read_be16(p + 2);
+}
+
+static inline void write_be16(std::vector<uint8_t> &out, uint32_t v) {
+    out.push_back((uint8_t)(v >> 8));
+    out.push_back((uint8_t)v);
+}
+
+static inline void write_be32(std::vector<uint8_t> &out, uint32_t v) {
+    write_be16(out, v >> 16);
+    write_be16(out, v & 0xFFFF);
+}
+
+
+// Number of layers of the main header, checking that its packets can be dropped
+static int parse_main_header(const uint8_t *cs, size_t hlen, uint16_t *numlayers) {
+    *numlayers = 0;
+    size_t pos = 2;
+    while (pos + 4 <= hlen) {
+        uint32_t marker = read_be16(cs + pos);
+        size_t seglen = 2 + read_be16(cs + pos + 2);
+        if (marker == J2K_COD && seglen >= 9) {
+            uint8_t scod = cs[pos + 4];
+            uint8_t progression = cs[pos + 5];
+            *numlayers = (uint16_t)read_be16(cs + pos + 6);
+            if (scod & 0x06) {
+                fprintf(stderr, "Codestreams with SOP or EPH markers cannot be truncated\n");
+                return BLOSC2_ERROR_INVALID_PARAM;
+            }
+            if (progression != GRK_LRCP) {
+                fprintf(stderr, "Only codestreams in LRCP progression order can be truncated\n");
+                return BLOSC2_ERROR_INVALID_PARAM;
+            }
+        } else if (marker == J2K_POC || marker == J2K_PPM) {
+            fprintf(stderr, "Codestreams with POC or PPM markers cannot be truncated\n");
+            return BLOSC2_ERROR_INVALID_PARAM;
+        }
+        pos += seglen;
+    }
+    if (*numlayers == 0) {
+        fprintf(stderr, "Cannot find the COD marker of the codestream\n");
+        return BLOSC2_ERROR_FAILURE;
+    }
+    return 0;
+}
+
+
+// Packet lengths of a PLT segment (Iplt values: 7 bits per byte, big endian)
+static int parse_plt(const uint8_t *seg, size_t seglen, std::vector<uint32_t> &packets) {
+    uint32_t value = 0;
+    for (size_t i = 5; i < seglen; ++i) {
+        value = (value << 7) | (seg[i] & 0x7F);
+        if (!(seg[i] & 0x80)) {
+            packets.push_back(value);
+            value = 0;
+        }
+    }
+    return value == 0 ? 0 : BLOSC2_ERROR_FAILURE;
+}
+
+
+static int parse_tile_parts(const uint8_t *cs, size_t len, size_t pos, layered_block &lb) {
+    std::vector<bool> seen;
+    // SOT segment: marker, Lsot, Isot (2 bytes), Psot (4 bytes), TPsot, TNsot
+    while (pos + 12 <= len && read_be16(cs + pos) == J2K_SOT) {
+        uint32_t isot = read_be16(cs + pos + 4);
+        size_t psot = read_be32(cs + pos + 6);
+        if (psot == 0) {
+            // Last tile-part, up to the EOC
+            psot = len - 2 - pos;
+        }
+        if (pos + psot > len) {
+            fprintf(stderr, "Invalid tile-part in the codestream\n");
+            return BLOSC2_ERROR_FAILURE;
+        }
+        if (isot >= seen.size()) {
+            seen.resize(isot + 1);
+        }
+        if (seen[isot]) {
+            fprintf(stderr, "Codestreams with several tile-parts per tile cannot be truncated\n");
+            return BLOSC2_ERROR_INVALID_PARAM;
+        }
+        seen[isot] = true;
+
+        tile_part tp;
+        tp.header.assign(cs + pos + 4, cs + pos + 6);
+        tp.header.insert(tp.header.end(), cs + pos + 10, cs + pos + 12);
+        size_t end = pos + psot;
+        size_t p = pos + 12;
+        while (p + 2 <= end && read_be16(cs + p) != J2K_SOD) {
+            uint32_t marker = read_be16(cs + p);
+            size_t seglen = 2 + read_be16(cs + p + 2);
+            if (p + seglen > end) {
+                fprintf(stderr, "Invalid tile-part header in the codestream\n");
+                return BLOSC2_ERROR_FAILURE;
+            }
+            if (marker == J2K_PLT) {
+                BLOSC_ERROR(parse_plt(cs + p, seglen, tp.packets));
+            } else if (marker == J2K_COD || marker == J2K_COC || marker == J2K_POC || marker == J2K_PPT) {
+                fprintf(stderr, "Tile-parts with COD, COC, POC or PPT markers cannot be truncated\n");
+                return BLOSC2_ERROR_INVALID_PARAM;
+            } else {
+                tp.header.insert(tp.header.end(), cs + p, cs + p + seglen);
+            }
+            p += seglen;
+        }
+        if (p + 2 > end) {
+            fprintf(stderr, "Cannot find the SOD marker of a tile-part\n");
+            return BLOSC2_ERROR_FAILURE;
+        }
+        tp.data = cs + p + 2;
+        uint64_t total = 0;
+        for (uint32_t plen : tp.packets) {
+            total += plen;
+        }
+        if (tp.packets.empty() || total != end - p - 2) {
+            fprintf(stderr, "Truncating a codestream needs its PLT markers (writePLT)\n");
+            return BLOSC2_ERROR_INVALID_PARAM;
+        }
+        if (tp.packets.size() % lb.numlayers != 0) {
+            fprintf(stderr, "Unexpected number of packets in a tile-part\n");
+            return BLOSC2_ERROR_FAILURE;
+        }
+        lb.tps.push_back(std::move(tp));
+        pos = end;
+    }
+    if (lb.tps.empty()) {
+        fprintf(stderr, "Cannot find the tile-parts of the codestream\n");
+        return BLOSC2_ERROR_FAILURE;
+    }
+    lb.trailer = cs + pos;
+    lb.trailer_len = len - pos;
+    return 0;
+}
+
+
+static int parse_block(const uint8_t *block, size_t len, const uint8_t *header, size_t header_len,
+                       layered_block &lb) {
+    const uint8_t *cs = block;
+    size_t cs_len = len;
+    lb.box_start = 0;
+    lb.box_header = 0;
+    lb.box_to_end = false;
+    lb.suffix = block + len;
+    lb.suffix_len = 0;
+    if (len >= 12 && read_be32(block + 4) == JP2_JP) {
+        // JP2 file: look for the codestream box
+        size_t pos = 0;
+        while (pos + 8 <= len) {
+            uint64_t lbox = read_be32(block + pos);
+            size_t hdr = 8;
+            if (lbox == 1 && pos + 16 <= len) {
+                lbox = ((uint64_t)read_be32(block + pos + 8) << 32) | read_be32(block + pos + 12);
+                hdr = 16;
+            } else if (lbox == 0) {
+                lbox = len - pos;
+            }
+            if (lbox < hdr || pos + lbox > len) {
+                break;
+            }
+            if (read_be32(block + pos + 4) == JP2_JP2C) {
+                lb.box_start = pos;
+                lb.box_header = hdr;
+                lb.box_to_end = read_be32(block + pos) == 0;
+                cs = block + pos + hdr;
+                cs_len = lbox - hdr;
+                lb.suffix = block + pos + lbox;
+                lb.suffix_len = len - pos - lbox;
+                break;
+            }
+            pos += lbox;
+        }
+        if (lb.box_header == 0) {
+            fprintf(stderr, "Cannot find the codestream box of the JP2 file\n");
+            return BLOSC2_ERROR_FAILURE;
+        }
+    }
+
+    size_t pos = 0;
+    if (cs_len >= 2 && read_be16(cs) == J2K_SOC) {
+        int64_t hlen = get_main_header_len(cs, cs_len);
+        if (hlen < 0) {
+            fprintf(stderr, "Cannot find the main header of the codestream\n");
+            return BLOSC2_ERROR_FAILURE;
+        }
+        BLOSC_ERROR(parse_main_header(cs, hlen, &lb.numlayers));
+        lb.main = copy_main_header(cs, hlen);
+        pos = hlen;
+    } else {
+        // Headerless block: the main header is the shared one
+        int64_t hlen = header != nullptr ? get_main_header_len(header, header_len) : -1;
+        if (hlen < 0) {
+            fprintf(stderr, "Cannot find the main header of a headerless block\n");
+            return BLOSC2_ERROR_INVALID_PARAM;
+        }
+        BLOSC_ERROR(parse_main_header(header, hlen, &lb.numlayers));
+    }
+    return parse_tile_parts(cs, cs_len, pos, lb);
+}
+
+
+// Number of packets of a tile-part kept with `layers` layers
+static inline size_t kept_packets(const tile_part &tp, uint16_t numlayers, uint16_t layers) {
+    return tp.packets.size() / numlayers * layers;
+}
+
+static inline size_t iplt_len(uint32_t v) {
+    size_t n = 1;
+    while (v >>= 7) {
+        n++;
+    }
+    return n;
+}
+
+// Packet lengths of a tile-part with `layers` layers (the others are empty, 1 byte)
+static void get_lengths(const tile_part &tp, uint16_t numlayers, uint16_t layers, std::vector<uint32_t> &lengths) {
+    size_t kept = kept_packets(tp, numlayers, layers);
+    lengths.assign(tp.packets.begin(), tp.packets.begin() + kept);
+    lengths.resize(tp.packets.size(), 1);
+}
+
+static size_t tile_part_size(const tile_part &tp, uint16_t numlayers, uint16_t layers) {
+    std::vector<uint32_t> lengths;
+    get_lengths(tp, numlayers, layers, lengths);
+    // PLT segments are filled as in write_tile_part
+    size_t plt = 0, nbytes = 0, data = 0;
+    for (uint32_t plen : lengths) {
+        size_t n = iplt_len(plen);
+        if (plt == 0 || nbytes + n > MAX_PLT_DATA) {
+            plt += 5;
+            nbytes = 0;
+        }
+        plt += n;
+        nbytes += n;
+        data += plen;
+    }
+    // SOT + other segments + PLT segments + SOD + packets
+    return 4 + 4 + tp.header.size() + plt + 2 + data;
+}
+
+static size_t block_size(const layered_block &lb, uint16_t layers) {
+    size_t size = lb.box_start + lb.box_header + lb.main.size() + lb.trailer_len + lb.suffix_len;
+    for (const auto &tp : lb.tps) {
+        size += tile_part_size(tp, lb.numlayers, layers);
+    }
+    return size;
+}
+
+
+static void write_tile_part(const tile_part &tp, uint16_t numlayers, uint16_t layers, std::vector<uint8_t> &out) {
+    std::vector<uint32_t> lengths;
+    get_lengths(tp, numlayers, layers, lengths);
+    write_be16(out, J2K_SOT);
+    write_be16(out, 10);
+    out.insert(out.end(), tp.header.begin(), tp.header.begin() + 2);
+    write_be32(out, (uint32_t)tile_part_size(tp, numlayers, layers));
+    out.insert(out.end(), tp.header.begin() + 2, tp.header.end());
+
+    // PLT segments, none of them splitting a packet length
+    uint8_t zplt = 0;
+    size_t i = 0;
+    while (i < lengths.size()) {
+        size_t start = out.size();
+        write_be16(out, J2K_PLT);
+        write_be16(out, 0);
+        out.push_back(zplt++);
+        size_t nbytes = 0;
+        for (; i < lengths.size() && nbytes + iplt_len(lengths[i]) <= MAX_PLT_DATA; ++i) {
+            size_t n = iplt_len(lengths[i]);
+            for (size_t k = n; k-- > 0;) {
+                out.push_back((uint8_t)(((lengths[i] >> (7 * k)) & 0x7F) | (k > 0 ? 0x80 : 0)));
+            }
+            nbytes += n;
+        }
+        size_t lplt = out.size() - start - 2;
+        out[start + 2] = (uint8_t)(lplt >> 8);
+        out[start + 3] = (uint8_t)lplt;
+    }
+
+    write_be16(out, J2K_SOD);
+    size_t kept = kept_packets(tp, numlayers, layers);
+    size_t data = 0;
+    for (size_t k = 0; k < kept; ++k) {
+        data += tp.packets[k];
+    }
+    out.insert(out.end(), tp.data, tp.data + data);
+    // An empty packet is a packet header with a single 0 bit
+    out.resize(out.size() + tp.packets.size() - kept, 0);
+}
+
+
+int truncate_block(const uint8_t *block, size_t len, const uint8_t *header, size_t header_len,
+                   uint16_t layers, size_t budget, std::vector<uint8_t> &out) {
+    layered_block lb;
+    BLOSC_ERROR(parse_block(block, len, header, header_len, lb));
+    if (layers == 0 || layers > lb.numlayers) {
+        layers = lb.numlayers;
+    }
+    if (budget > 0) {
+        while (layers > 1 && block_size(lb, layers) > budget) {
+            layers--;
+        }
+    }
+
+    out.clear();
+    out.reserve(block_size(lb, layers));
+    out.insert(out.end(), block, block + lb.box_start);
+    if (lb.box_header > 0) {
+        size_t box_len = block_size(lb, layers) - lb.box_start - lb.suffix_len;
+        if (lb.box_to_end) {
+            write_be32(out, 0);
+        } else if (lb.box_header == 16) {
+            write_be32(out, 1);
+        } else {
+            write_be32(out, (uint32_t)box_len);
+        }
+        write_be32(out, JP2_JP2C);
+        if (lb.box_header == 16) {
+            write_be32(out, (uint32_t)((uint64_t)box_len >> 32));
+            write_be32(out, (uint32_t)box_len);
+        }
+    }
+    out.insert(out.end(), lb.main.begin(), lb.main.end());
+    for (const auto &tp : lb.tps) {
+        write_tile_part(tp, lb.numlayers, layers, out);
+    }
+    out.insert(out.end(), lb.trailer, lb.trailer + lb.trailer_len);
+    out.insert(out.end(), lb.suffix, lb.suffix + lb.suffix_len);
+    return layers;
+}
@@ -0,0 +1,30 @@
+/*********************************************************************
+ * blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+ *
+ * Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+ * https://blosc.org
+ * License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+**********************************************************************/
+
+#ifndef BLOSC2_GROK_TRANSCODE_H
+#define BLOSC2_GROK_TRANSCODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Drop the quality layers above `layers` from the codestream of a block (a
+// JP2 file, a raw codestream or the tile-parts of a headerless block, whose
+// main header is `header`).  The packets of the dropped layers are replaced
+// by empty ones, so that the main header (which may be shared by other
+// blocks) stays valid; nothing is decoded or coded again.  With a non-zero
+// `budget`, the largest number of layers up to `layers` whose codestream
+// fits in `budget` bytes is kept instead (at least one).
+//
+// Only LRCP codestreams with PLT markers (writePLT), one tile-part per tile
+// and no SOP/EPH markers or packed packet headers can be truncated.  Returns
+// the number of layers kept, or a negative BLOSC2_ERROR_* code.
+int truncate_block(const uint8_t *block, size_t len, const uint8_t *header, size_t header_len,
+                   uint16_t layers, size_t budget, std::vector<uint8_t> &out);
+
+#endif
@@ -0,0 +1,44 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+# Helpers shared by the tests (import them with `from conftest import ...`)
+
+import numpy as np
+
+import blosc2
+import blosc2_grok
+
+
+def compress(np_array, blocks=None, chunks=None, codec_meta=0, nthreads=None, **kwargs):
+    """
+    Compress `np_array` with grok, in a single chunk and block unless `chunks`
+    and `blocks` say otherwise.  `kwargs` are set as the plugin defaults just
+    for this array.
+    """
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'codec_meta': codec_meta,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    if nthreads is not None:
+        cparams['nthreads'] = nthreads
+    if chunks is None:
+        chunks = np_array.shape
+    if blocks is None:
+        blocks = chunks
+    blosc2_grok.set_params_defaults(**kwargs)
+    try:
+        return blosc2.asarray(np_array, chunks=chunks, blocks=blocks, cparams=cparams)
+    finally:
+        blosc2_grok.set_params_defaults()
+
+
+def psnr(a, b, peak=255):
+    mse = np.mean((a.astype(np.float64) - b) ** 2)
+    return np.inf if mse == 0 else 10 * np.log10(peak ** 2 / mse)
@@ -0,0 +1,47 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+
+project_dir = Path(__file__).parent.parent
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('nthreads', [1, 4])
+def test_arena(image, nthreads):
+    im = Image.open(image)
+    # Convert the image to a numpy array, and stack some copies of it
+    np_array = np.asarray(im)
+    np_array = np.stack([np_array] * 16)
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+        'nthreads': nthreads,
+    }
+
+    blosc2_grok.get_arena_stats(reset=True)
+    bl_array = blosc2.asarray(
+        np_array,
+        chunks=np_array.shape,
+        blocks=(1,) + np_array.shape[1:],
+        cparams=cparams,
+    )
+    stats = blosc2_grok.get_arena_stats()
+    print(stats)
+
+    # Every thread allocates at most once for blocks with the same geometry
+    assert stats['image_hits'] + stats['image_misses'] == 16
+    assert stats['image_misses'] <= nthreads
+    np.testing.assert_array_equal(bl_array[...], np_array)
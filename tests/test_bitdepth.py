@@ -0,0 +1,61 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+from conftest import compress
+
+project_dir = Path(__file__).parent.parent
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('bits', [8, 12, 14])
+def test_bitdepth(image, bits):
+    im = Image.open(image).convert('L')
+    # A uint16 image using only `bits` bits
+    np_array = np.asarray(im).astype(np.uint16) << (bits - 8)
+
+    full = compress(np_array, bit_depth=16)
+    auto = compress(np_array)
+    fixed = compress(np_array, bit_depth=bits)
+
+    # Lossless in every case, with samples widened back to uint16
+    for array in (full, auto, fixed):
+        assert array.dtype == np.uint16
+        np.testing.assert_array_equal(array[...], np_array)
+    assert auto.schunk.cbytes == fixed.schunk.cbytes
+    assert auto.schunk.cbytes <= full.schunk.cbytes
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_bitdepth_rate(image):
+    im = Image.open(image).convert('L')
+    np_array = np.asarray(im).astype(np.uint16) << 4
+
+    # Rates are relative to the stored uint16 samples
+    array = compress(np_array, codec_meta=8 * 10)
+    assert array.schunk.cratio >= 8 - 0.1
+    _ = array[...]
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('bits', [8, 12])
+def test_bitdepth_no_schunk(image, bits):
+    im = Image.open(image).convert('L')
+    np_array = np.asarray(im).astype(np.uint16) << (bits - 8)
+    array = compress(np_array)
+    # A chunk decoded on its own has no super-chunk to take the typesize from
+    chunk = array.schunk.get_chunk(0)
+    out = np.frombuffer(blosc2.decompress2(chunk), dtype=np.uint16).reshape(np_array.shape)
+    np.testing.assert_array_equal(out, np_array)
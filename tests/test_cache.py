@@ -0,0 +1,69 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+
+project_dir = Path(__file__).parent.parent
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('nthreads', [1, 4])
+def test_cache(image, nthreads):
+    im = Image.open(image)
+    # Convert the image to a numpy array
+    np_array = np.asarray(im)
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+        'nthreads': nthreads,
+    }
+    dparams = {'nthreads': nthreads}
+    bl_array = blosc2.asarray(np_array, chunks=(256, 256, 3), blocks=(128, 128, 3),
+                              cparams=cparams, dparams=dparams)
+    nblocks = bl_array.schunk.nchunks * 4
+
+    blosc2_grok.set_decode_cache(64 * 2**20)
+    try:
+        blosc2_grok.get_cache_stats(reset=True)
+        np.testing.assert_array_equal(bl_array[...], np_array)
+        stats = blosc2_grok.get_cache_stats()
+        assert stats['hits'] + stats['misses'] == nblocks
+        assert stats['nblocks'] == stats['misses']
+
+        # Everything is cached now
+        np.testing.assert_array_equal(bl_array[...], np_array)
+        stats = blosc2_grok.get_cache_stats(reset=True)
+        assert stats['hits'] >= nblocks
+        assert stats['evictions'] == 0
+
+        # A cache for a few blocks only
+        blosc2_grok.set_decode_cache(16 * 128 * 128 * 3)
+        assert blosc2_grok.get_cache_stats()['nbytes'] <= 16 * 128 * 128 * 3
+        np.testing.assert_array_equal(bl_array[...], np_array)
+        assert blosc2_grok.get_cache_stats()['evictions'] > 0
+
+        # The budget is global, so a cache for two blocks (and their codestreams)
+        # still holds one or two of them
+        blosc2_grok.set_decode_cache(2 * 128 * 128 * 3)
+        np.testing.assert_array_equal(bl_array[...], np_array)
+        stats = blosc2_grok.get_cache_stats()
+        assert 1 <= stats['nblocks'] <= 2
+        assert stats['nbytes'] <= 2 * 128 * 128 * 3
+    finally:
+        blosc2_grok.set_decode_cache(0)
+
+    stats = blosc2_grok.get_cache_stats()
+    assert stats['nbytes'] == 0 and stats['nblocks'] == 0
+    np.testing.assert_array_equal(bl_array[...], np_array)
@@ -0,0 +1,78 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+from conftest import compress
+
+project_dir = Path(__file__).parent.parent
+
+
+def sparse(image, dtype=np.uint8):
+    # The image on a uniform background, with a masked (zero) band
+    im = np.asarray(Image.open(image)).astype(dtype)
+    array = np.empty((im.shape[0] * 2, im.shape[1] * 2, im.shape[2]), dtype=dtype)
+    array[...] = np.array([40, 120, 200], dtype=dtype)
+    array[:im.shape[0], :im.shape[1]] = im
+    array[:, -128:] = 0
+    return array
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('dtype', [np.uint8, np.uint16])
+@pytest.mark.parametrize('kwargs', [{}, {'headerless': True},
+                                    {'quality_mode': 'rates', 'quality_layers': np.array([10], dtype=np.float64)}])
+def test_const_blocks(image, dtype, kwargs):
+    array = sparse(image, dtype)
+    dense = compress(array[:512, :768], chunks=(512, 768, 3), blocks=(128, 128, 3), nthreads=1, **kwargs)
+    b2 = compress(array, chunks=(512, 768, 3), blocks=(128, 128, 3), nthreads=1, **kwargs)
+    out = b2[...]
+    # Constant blocks are exact even in lossy modes
+    np.testing.assert_array_equal(out[512:], array[512:])
+    np.testing.assert_array_equal(out[:, -128:], 0)
+    if not kwargs:
+        np.testing.assert_array_equal(out, array)
+    # Three quarters of the array take next to nothing
+    assert b2.schunk.cbytes < dense.schunk.cbytes * 1.1
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('reduce', [0, 1])
+def test_const_slice(image, reduce):
+    array = sparse(image)
+    b2 = compress(array, chunks=(512, 768, 3), blocks=(128, 128, 3), nthreads=1)
+    key = (slice(400, 700), slice(600, 1000))
+    out = blosc2_grok.get_slice(b2, key, reduce=reduce)
+    if reduce == 0:
+        np.testing.assert_array_equal(out, array[key])
+    # Constant blocks subsample to the same pixel
+    np.testing.assert_array_equal(out[-10:, -10:], np.broadcast_to(array[600, 900], (10, 10, 3)))
+
+
+def test_const_planar():
+    # Every plane is constant, with a different value, so blocks of a plane each are constant
+    array = np.empty((3, 256, 256), dtype=np.uint16)
+    array[:] = np.array([1000, 2000, 3000], dtype=np.uint16)[:, None, None]
+    b2 = compress(array, chunks=array.shape, blocks=(1, 128, 128), nthreads=1, layout="CHW")
+    np.testing.assert_array_equal(b2[...], array)
+    assert b2.schunk.cratio > 100
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_const_truncate(image):
+    array = sparse(image)
+    b2 = compress(array, chunks=(512, 768, 3), blocks=(128, 128, 3), nthreads=1,
+                  quality_mode='rates', writePLT=True, quality_layers=np.array([40, 10, 1], dtype=np.float64))
+    blosc2_grok.truncate_layers(b2, layers=1)
+    np.testing.assert_array_equal(b2[512:], array[512:])
@@ -38,3 +38,33 @@ def test_def_params(image):
     )
     
     np.testing.assert_array_equal(bl_array[...], np_array)
+
+
+@pytest.mark.parametrize(
+    'kwargs',
+    [
+        ({'headerless': True}),
+        ({'tiled_chunk': True}),
+        ({'bit_depth': 12}),
+        ({'float_error': 0.1, 'float_rel_error': 0.01}),
+        ({'layout': "CHW"}),
+        ({'layout': "SHWC"}),
+        ({'spectral_levels': 2}),
+        ({'target_psnr': 40., 'target_ssim': 0.99}),
+        ({'rate_correction': True}),
+        ({'mode': blosc2_grok.GrkMode.HT, 'quality_mode': 'rates',
+          'quality_layers': np.array([10], dtype=np.float64)}),
+    ],
+)
+def test_plugin_params(kwargs):
+    # Every option of the plugin goes through to the C side
+    try:
+        blosc2_grok.set_params_defaults(**kwargs)
+    finally:
+        blosc2_grok.set_params_defaults()
+
+
+def test_invalid_params():
+    with pytest.raises(ValueError):
+        blosc2_grok.set_params_defaults(layout="WHC")
+    blosc2_grok.set_params_defaults()
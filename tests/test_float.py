@@ -0,0 +1,85 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+from conftest import compress
+
+project_dir = Path(__file__).parent.parent
+
+
+def float_image(image):
+    im = np.asarray(Image.open(image).convert('L')).astype(np.float32)
+    # Smooth values with a fractional part, around zero
+    return (im - 100) / 7
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('error', [0.5, 0.01, 1e-4])
+def test_float_abs(image, error):
+    np_array = float_image(image)
+    array = compress(np_array, blocks=(np_array.shape[0] // 2, np_array.shape[1] // 2), float_error=error)
+    out = array[...]
+    assert out.dtype == np.float32
+    assert np.abs(out.astype(np.float64) - np_array).max() <= error
+    if error >= 0.01:
+        assert array.schunk.cratio > 2
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('rel_error', [1e-2, 1e-3])
+def test_float_rel(image, rel_error):
+    np_array = float_image(image)
+    array = compress(np_array, float_rel_error=rel_error)
+    out = array[...]
+    bound = rel_error * (np_array.max() - np_array.min())
+    assert np.abs(out.astype(np.float64) - np_array).max() <= bound
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_float_window(image):
+    np_array = float_image(image)
+    array = compress(np_array, float_error=0.01)
+    out = blosc2_grok.get_slice(array, (slice(10, 90), slice(20, 300)))
+    assert np.abs(out.astype(np.float64) - np_array[10:90, 20:300]).max() <= 0.01
+
+
+@pytest.mark.parametrize('value', [np.nan, np.inf])
+def test_float_nonfinite(value):
+    np_array = np.linspace(0, 1, 64 * 64, dtype=np.float32).reshape(64, 64)
+    np_array[3, 5] = value
+    # Stored as is
+    array = compress(np_array, float_error=0.01)
+    np.testing.assert_array_equal(array[...], np_array)
+
+
+def test_float_constant():
+    np_array = np.full((64, 64), 3.25, dtype=np.float32)
+    array = compress(np_array, float_error=0.01)
+    np.testing.assert_array_equal(array[...], np_array)
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('kwargs', [
+    {'quality_mode': 'rates', 'quality_layers': np.array([20], dtype=np.float64)},
+    {'quality_mode': 'dB', 'quality_layers': np.array([30], dtype=np.float64)},
+    {'irreversible': True},
+    {'codec_meta': 10 * 10},
+    {'mode': blosc2_grok.GrkMode.HT, 'quality_mode': 'rates', 'quality_layers': np.array([20], dtype=np.float64)},
+])
+def test_float_lossy_params(image, kwargs):
+    np_array = float_image(image)
+    # Lossy coding is ignored for quantized blocks, so the bound still holds
+    array = compress(np_array, float_error=0.01, **kwargs)
+    assert np.abs(array[...].astype(np.float64) - np_array).max() <= 0.01
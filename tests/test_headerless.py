@@ -0,0 +1,46 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+
+project_dir = Path(__file__).parent.parent
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png', project_dir / 'examples/MI04_020751.tif'])
+@pytest.mark.parametrize('blocksize', [128, 256])
+def test_headerless(image, blocksize):
+    im = Image.open(image)
+    # Convert the image to a numpy array
+    np_array = np.asarray(im)
+    blocks = (blocksize, blocksize) + np_array.shape[2:]
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+        'nthreads': 4,
+    }
+
+    blosc2_grok.set_params_defaults()
+    full = blosc2.asarray(np_array, chunks=np_array.shape, blocks=blocks, cparams=cparams)
+
+    blosc2_grok.set_params_defaults(headerless=True)
+    try:
+        bl_array = blosc2.asarray(np_array, chunks=np_array.shape, blocks=blocks, cparams=cparams)
+    finally:
+        blosc2_grok.set_params_defaults()
+
+    header = bl_array.schunk.vlmeta['grok_header']
+    assert header[:2] == b'\xff\x4f'
+    assert bl_array.schunk.cbytes < full.schunk.cbytes
+    np.testing.assert_array_equal(bl_array[...], np_array)
@@ -0,0 +1,58 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+from conftest import compress, psnr
+
+project_dir = Path(__file__).parent.parent
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('rate', [4, 10, 30])
+@pytest.mark.parametrize('blocks', [(512, 768, 3), (128, 128, 3)])
+def test_ht_rates(image, rate, blocks):
+    im = np.asarray(Image.open(image))
+    array = compress(im, blocks, nthreads=1, mode=blosc2_grok.GrkMode.HT, quality_mode='rates',
+                     quality_layers=np.array([rate], dtype=np.float64))
+    # Every block fits in its budget, and does not land far from it
+    assert array.schunk.cratio >= rate - 0.1
+    assert array.schunk.cratio <= 2 * rate
+    out = array[...]
+    assert out.shape == im.shape
+    assert psnr(out, im) > 20
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_ht_meta(image):
+    im = np.asarray(Image.open(image).convert('L'))
+    array = compress(im, (256, 256), nthreads=1, mode=blosc2_grok.GrkMode.HT, codec_meta=80)
+    assert array.schunk.cratio >= 8 - 0.1
+    assert psnr(array[...], im) > 20
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_ht_lossless(image):
+    im = np.asarray(Image.open(image))
+    # A rate that lossless coding already reaches needs no scaling
+    array = compress(im, (256, 256, 3), nthreads=1, mode=blosc2_grok.GrkMode.HT,
+                     quality_mode='rates', quality_layers=np.array([1.05], dtype=np.float64))
+    np.testing.assert_array_equal(array[...], im)
+
+
+def test_ht_db():
+    with pytest.raises(ValueError):
+        blosc2_grok.set_params_defaults(mode=blosc2_grok.GrkMode.HT, quality_mode='dB',
+                                        quality_layers=np.array([40], dtype=np.float64))
+    blosc2_grok.set_params_defaults()
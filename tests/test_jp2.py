@@ -45,6 +45,7 @@ project_dir = Path(__file__).parent.parent
         ({'codeblock_size': (8, 64)}),
         ({'codeblock_size': (256, 8)}),
         ({'mode': blosc2_grok.GrkMode.HT}),
+        ({'mode': blosc2_grok.GrkMode.HT, 'quality_mode': 'rates', 'quality_layers': np.array([5], dtype=np.float64)}),
         ({'roi_compno': 0}),
         ({'roi_compno': 1}),
         ({'roi_compno': 2}),
@@ -0,0 +1,66 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+
+project_dir = Path(__file__).parent.parent
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png', project_dir / 'examples/MI04_020751.tif'])
+@pytest.mark.parametrize('headerless', [False, True])
+def test_layers(image, headerless):
+    im = Image.open(image)
+    # Convert the image to a numpy array
+    np_array = np.asarray(im)
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    # The last layer makes the image lossless
+    blosc2_grok.set_params_defaults(quality_mode='rates', quality_layers=np.array([40, 10, 1], dtype=np.float64),
+                                    headerless=headerless)
+    try:
+        bl_array = blosc2.asarray(
+            np_array,
+            chunks=(256, 256) + np_array.shape[2:],
+            blocks=(128, 128) + np_array.shape[2:],
+            cparams=cparams,
+        )
+    finally:
+        blosc2_grok.set_params_defaults()
+
+    np.testing.assert_array_equal(blosc2_grok.get_slice(bl_array), np_array)
+    np.testing.assert_array_equal(blosc2_grok.get_slice(bl_array, layers=3), np_array)
+
+    # Fewer layers, more error
+    errors = []
+    for layers in [1, 2]:
+        preview = blosc2_grok.get_slice(bl_array, layers=layers)
+        errors.append(np.abs(preview.astype(np.float64) - np_array.astype(np.float64)).mean())
+    assert errors[0] > errors[1] > 0
+
+    # Per array setting, used by the blosc2 decoder too
+    blosc2_grok.set_decode_layers(bl_array, 1)
+    np.testing.assert_array_equal(bl_array[...], blosc2_grok.get_slice(bl_array, layers=1))
+    np.testing.assert_array_equal(blosc2_grok.get_slice(bl_array), blosc2_grok.get_slice(bl_array, layers=1))
+    blosc2_grok.set_decode_layers(bl_array, None)
+    np.testing.assert_array_equal(bl_array[...], np_array)
+
+    # The limit is the one of the C side
+    blosc2_grok.set_decode_layers(bl_array, blosc2_grok.MAX_LAYERS)
+    assert bl_array.schunk.vlmeta['grok_layers'] == blosc2_grok.MAX_LAYERS
+    blosc2_grok.set_decode_layers(bl_array, None)
+    with pytest.raises(ValueError):
+        blosc2_grok.set_decode_layers(bl_array, blosc2_grok.MAX_LAYERS + 1)
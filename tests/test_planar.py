@@ -0,0 +1,64 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+from conftest import compress
+
+project_dir = Path(__file__).parent.parent
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('dtype', [np.uint8, np.uint16, np.uint32])
+def test_planar(image, dtype):
+    im = np.asarray(Image.open(image)).astype(dtype)
+    planes = np.ascontiguousarray(im.transpose(2, 0, 1))
+
+    array = compress(planes, layout="CHW")
+    assert array.schunk.vlmeta['grok_layout'] == "CHW"
+    np.testing.assert_array_equal(array[...], planes)
+    # Same components as the interleaved image, so about the same size
+    interleaved = compress(im)
+    assert array.schunk.cbytes < 1.1 * interleaved.schunk.cbytes
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_planar_slice(image):
+    im = np.asarray(Image.open(image))
+    planes = np.ascontiguousarray(im.transpose(2, 0, 1))
+    array = compress(planes, blocks=(3, 256, 256), layout="CHW")
+
+    key = (slice(None), slice(10, 300), slice(20, 500))
+    np.testing.assert_array_equal(blosc2_grok.get_slice(array, key), planes[key])
+    key = (1, slice(10, 300), slice(20, 500))
+    np.testing.assert_array_equal(blosc2_grok.get_slice(array, key), planes[key])
+    block = blosc2_grok.decode_block(array, 0, 0, window=((5, 60), (7, 90)))
+    np.testing.assert_array_equal(block, planes[:, 5:60, 7:90])
+    thumb = blosc2_grok.get_slice(array, reduce=1)
+    assert thumb.shape == (3, planes.shape[1] // 2, planes.shape[2] // 2)
+
+
+def test_planar_raw():
+    # Noise is stored as is by blosc2, and still read as planes
+    rng = np.random.default_rng(0)
+    planes = rng.integers(0, 256, size=(3, 64, 64), dtype=np.uint8)
+    array = compress(planes, layout="CHW")
+    np.testing.assert_array_equal(array[...], planes)
+    np.testing.assert_array_equal(blosc2_grok.get_slice(array, (slice(None), slice(3, 40), slice(5, 60))),
+                                  planes[:, 3:40, 5:60])
+
+
+def test_layout_invalid():
+    with pytest.raises(ValueError):
+        blosc2_grok.set_params_defaults(layout="WHC")
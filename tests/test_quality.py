@@ -0,0 +1,62 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+from conftest import compress, psnr
+
+project_dir = Path(__file__).parent.parent
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('target', [30, 40])
+@pytest.mark.parametrize('irreversible', [False, True])
+def test_target_psnr(image, target, irreversible):
+    im = np.asarray(Image.open(image).convert('L'))
+    blosc2_grok.get_quality_stats(reset=True)
+    # A fixed bit depth, for the peak to be 255
+    array = compress(im, (256, 256), nthreads=1, target_psnr=target, bit_depth=8, irreversible=irreversible)
+    stats = blosc2_grok.get_quality_stats(reset=True)
+    assert stats['blocks'] == len(range(0, im.shape[0], 256)) * len(range(0, im.shape[1], 256))
+    assert stats['min_psnr'] >= target
+    # Every block reaches the target, so the whole image does too
+    assert psnr(array[...], im) >= target
+    assert array.schunk.cratio > 1
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_target_ssim(image):
+    im = np.asarray(Image.open(image))
+    blosc2_grok.get_quality_stats(reset=True)
+    array = compress(im, (128, 128, 3), nthreads=1, target_ssim=0.99, bit_depth=8, irreversible=True)
+    stats = blosc2_grok.get_quality_stats(reset=True)
+    assert stats['min_ssim'] >= 0.99
+    assert array[...].shape == im.shape
+    # Higher targets cost more
+    tight = compress(im, (128, 128, 3), nthreads=1, target_ssim=0.999, bit_depth=8, irreversible=True)
+    assert tight.schunk.cbytes >= array.schunk.cbytes
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_target_warm_start(image):
+    # Later blocks start from the rate of the previous one, so they need fewer passes
+    im = np.asarray(Image.open(image).convert('L'))
+    stack = np.stack([im] * 8)
+    blosc2_grok.get_quality_stats(reset=True)
+    compress(stack[:1], (1,) + im.shape, nthreads=1, target_psnr=38, bit_depth=8)
+    cold = blosc2_grok.get_quality_stats(reset=True)
+    compress(stack, (1,) + im.shape, nthreads=1, target_psnr=38, bit_depth=8)
+    warm = blosc2_grok.get_quality_stats(reset=True)
+    assert warm['blocks'] == 8
+    assert warm['passes'] < 8 * cold['passes']
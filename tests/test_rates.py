@@ -0,0 +1,53 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+from conftest import compress
+
+project_dir = Path(__file__).parent.parent
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('rate', [10, 20])
+def test_rate_correction(image, rate):
+    im = np.asarray(Image.open(image).convert('L'))
+    kwargs = {'quality_mode': 'rates', 'quality_layers': np.array([rate], dtype=np.float64), 'irreversible': True}
+    plain = compress(im, (128, 128), nthreads=1, **kwargs)
+    corrected = compress(im, (128, 128), nthreads=1, rate_correction=True, **kwargs)
+    # Corrections are bounded, so the ratio cannot be far from the target
+    assert corrected.schunk.cratio >= rate / 2
+    assert corrected.schunk.cratio <= 2 * rate
+    assert abs(corrected.schunk.cratio - rate) <= abs(plain.schunk.cratio - rate) + 0.1 * rate
+    out = corrected[...]
+    assert out.shape == im.shape
+    mse = np.mean((out.astype(np.float64) - im) ** 2)
+    assert 10 * np.log10(255 ** 2 / mse) > 20
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_rate_correction_meta(image):
+    im = np.asarray(Image.open(image).convert('L'))
+    array = compress(im, (128, 128), nthreads=1, codec_meta=100, rate_correction=True, irreversible=True)
+    assert array.schunk.cratio >= 5
+    assert array[...].shape == im.shape
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_rate_correction_lossless(image):
+    im = np.asarray(Image.open(image).convert('L'))
+    # The last layer is lossless, so there is nothing to correct
+    kwargs = {'quality_mode': 'rates', 'quality_layers': np.array([10, 1], dtype=np.float64)}
+    array = compress(im, (128, 128), nthreads=1, rate_correction=True, **kwargs)
+    np.testing.assert_array_equal(array[...], im)
@@ -0,0 +1,72 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+
+project_dir = Path(__file__).parent.parent
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png', project_dir / 'examples/MI04_020751.tif'])
+@pytest.mark.parametrize('headerless', [False, True])
+def test_reduce(image, headerless):
+    im = Image.open(image)
+    # Convert the image to a numpy array
+    np_array = np.asarray(im)
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    blosc2_grok.set_params_defaults(headerless=headerless)
+    try:
+        bl_array = blosc2.asarray(
+            np_array,
+            chunks=(256, 256) + np_array.shape[2:],
+            blocks=(128, 128) + np_array.shape[2:],
+            cparams=cparams,
+        )
+    finally:
+        blosc2_grok.set_params_defaults()
+
+    # Full resolution is exact
+    key = (slice(100, 300), slice(50, 400))
+    np.testing.assert_array_equal(blosc2_grok.get_slice(bl_array, key), np_array[key])
+
+    for reduce in [1, 2]:
+        scale = 2 ** reduce
+        thumb = blosc2_grok.get_slice(bl_array, reduce=reduce)
+        expected = np_array[::scale, ::scale]
+        assert thumb.shape == expected.shape
+        # The low-pass band is close to a decimated image
+        diff = np.abs(thumb.astype(np.float64) - expected.astype(np.float64))
+        assert diff.mean() < 0.1 * np.abs(expected.astype(np.float64)).mean() + 1
+
+    with pytest.raises(RuntimeError):
+        blosc2_grok.get_slice(bl_array, reduce=6)
+
+
+@pytest.mark.parametrize('blocks', [(1, 1), (1, 8)])
+def test_reduce_unit_blocks(blocks):
+    # Blocks with no column (or no row) dimension hold a single pixel (or row)
+    np_array = np.arange(8 * 8, dtype=np.uint16).reshape(8, 8) * 97
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    bl_array = blosc2.asarray(np_array, chunks=(4, 8), blocks=blocks, cparams=cparams)
+
+    key = (slice(1, 7), slice(2, 6))
+    np.testing.assert_array_equal(blosc2_grok.get_slice(bl_array, key), np_array[key])
+    np.testing.assert_array_equal(blosc2_grok.get_slice(bl_array, (3, 5)), np_array[3, 5])
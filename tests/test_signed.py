@@ -0,0 +1,63 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+from conftest import compress
+
+project_dir = Path(__file__).parent.parent
+
+
+def signed_image(image, dtype):
+    im = np.asarray(Image.open(image).convert('L')).astype(np.int32)
+    if dtype == np.int8:
+        return (im - 128).astype(np.int8)
+    # Like CT data in Hounsfield units: air is -1000 and bone reaches +1000 and more
+    return (im * 12 - 1024).astype(np.int16)
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('dtype', [np.int8, np.int16])
+@pytest.mark.parametrize('kwargs', [{}, {'bit_depth': 0}, {'tiled_chunk': True}])
+def test_signed_lossless(image, dtype, kwargs):
+    np_array = signed_image(image, dtype)
+    if kwargs.get('tiled_chunk'):
+        kwargs = dict(kwargs, blocks=(np_array.shape[0] // 2, np_array.shape[1] // 2))
+
+    array = compress(np_array, **kwargs)
+    assert array.dtype == dtype
+    np.testing.assert_array_equal(array[...], np_array)
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_signed_bitdepth(image):
+    # Samples of a signed 12-bit sensor stored as int16
+    np_array = signed_image(image, np.int16) // 2
+
+    full = compress(np_array, bit_depth=16)
+    auto = compress(np_array)
+    np.testing.assert_array_equal(auto[...], np_array)
+    assert auto.schunk.cbytes <= full.schunk.cbytes
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_signed_lossy(image):
+    np_array = signed_image(image, np.int16)
+
+    # Lossy decoding saturates to the int16 range instead of wrapping around
+    array = compress(np_array, codec_meta=10 * 10)
+    out = array[...]
+    assert out.dtype == np.int16
+    err = np.abs(out.astype(np.int32) - np_array.astype(np.int32))
+    assert err.mean() < 100
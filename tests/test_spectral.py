@@ -0,0 +1,72 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+from conftest import compress
+
+project_dir = Path(__file__).parent.parent
+
+
+def cube(image, nbands, dtype, scale):
+    # Every band is the same scene under a smoothly varying spectral response
+    gray = np.asarray(Image.open(image).convert('L'))[:128, :160].astype(np.float64)
+    response = 0.6 + 0.4 * np.sin(np.linspace(0, np.pi, nbands))
+    bands = gray[..., None] * response * scale
+    if np.dtype(dtype).kind == 'i':
+        bands -= bands.max() / 2
+    return np.round(bands).astype(dtype)
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('nbands', [2, 5, 16, 33])
+@pytest.mark.parametrize('dtype, scale', [(np.uint8, 1), (np.uint16, 16), (np.int16, 16)])
+@pytest.mark.parametrize('levels', [1, 3, 8])
+def test_spectral(image, nbands, dtype, scale, levels):
+    np_array = cube(image, nbands, dtype, scale)
+    array = compress(np_array, spectral_levels=levels)
+    np.testing.assert_array_equal(array[...], np_array)
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_spectral_ratio(image):
+    np_array = cube(image, 32, np.uint16, 16)
+    plain = compress(np_array)
+    spectral = compress(np_array, spectral_levels=5)
+    np.testing.assert_array_equal(spectral[...], np_array)
+    assert spectral.schunk.cbytes < plain.schunk.cbytes
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_spectral_planar(image):
+    planes = np.ascontiguousarray(cube(image, 12, np.uint16, 16).transpose(2, 0, 1))
+    array = compress(planes, blocks=(12, 64, 64), spectral_levels=4, layout="CHW")
+    np.testing.assert_array_equal(array[...], planes)
+    key = (slice(2, 9), slice(10, 100), slice(20, 150))
+    np.testing.assert_array_equal(blosc2_grok.get_slice(array, key), planes[key])
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_spectral_float(image):
+    np_array = cube(image, 8, np.float32, 0.01)
+    array = compress(np_array, spectral_levels=3, float_error=1e-3)
+    assert np.abs(array[...] - np_array).max() <= 1e-3
+
+
+def test_spectral_wide():
+    # Details of full range 16-bit noise do not fit in 16 bits: coded as they are
+    rng = np.random.default_rng(0)
+    np_array = rng.integers(0, 1 << 16, size=(32, 32, 6), dtype=np.uint16)
+    array = compress(np_array, spectral_levels=2)
+    np.testing.assert_array_equal(array[...], np_array)
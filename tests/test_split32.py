@@ -0,0 +1,56 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+from conftest import compress
+
+project_dir = Path(__file__).parent.parent
+
+
+def gray(image):
+    return np.asarray(Image.open(image).convert('L')).astype(np.int64)
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('dtype', [np.uint32, np.int32])
+@pytest.mark.parametrize('scale', [1, 1 << 10, 1 << 23])
+def test_split32(image, dtype, scale):
+    np_array = gray(image) * scale
+    if dtype == np.int32:
+        np_array -= 128 * scale
+    np_array = np_array.astype(dtype)
+
+    array = compress(np_array)
+    assert array.dtype == dtype
+    np.testing.assert_array_equal(array[...], np_array)
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_split32_sparse_high(image):
+    # Photon counts: the high words are all zero and cost next to nothing
+    counts = gray(image).astype(np.uint32)
+    array32 = compress(counts)
+    array16 = compress(counts.astype(np.uint16))
+    np.testing.assert_array_equal(array32[...], counts)
+    assert array32.schunk.cbytes < 1.1 * array16.schunk.cbytes
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_split32_rgb(image):
+    im = np.asarray(Image.open(image)).astype(np.uint32) * 1000
+    array = compress(im)
+    np.testing.assert_array_equal(array[...], im)
+    out = blosc2_grok.get_slice(array, (slice(5, 50), slice(7, 100)))
+    np.testing.assert_array_equal(out, im[5:50, 7:100])
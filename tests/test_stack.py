@@ -0,0 +1,74 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+from conftest import compress
+
+project_dir = Path(__file__).parent.parent
+
+
+def frames(image, nframes, dtype, scale=16):
+    # Slowly drifting frames of the same scene, with a little noise
+    gray = np.asarray(Image.open(image).convert('L'))[:128, :192].astype(np.float64) * scale
+    rng = np.random.default_rng(0)
+    stack = [gray * (1 + 0.01 * k) + rng.normal(scale=2, size=gray.shape) for k in range(nframes)]
+    stack = np.clip(np.round(stack), 0, None)
+    if np.dtype(dtype).kind == 'i':
+        stack -= stack.max() // 2
+    return stack.astype(dtype)
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('nframes', [2, 7, 16])
+@pytest.mark.parametrize('dtype', [np.uint16, np.int16, np.uint32])
+def test_stack(image, nframes, dtype):
+    np_array = frames(image, nframes, dtype)
+    array = compress(np_array, layout="SHWC")
+    assert array.schunk.vlmeta['grok_layout'] == "SHWC"
+    np.testing.assert_array_equal(array[...], np_array)
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_stack_ratio(image):
+    np_array = frames(image, 16, np.uint16)
+    per_frame = compress(np_array, blocks=(1,) + np_array.shape[1:])
+    stack = compress(np_array, layout="SHWC")
+    np.testing.assert_array_equal(stack[...], np_array)
+    assert stack.schunk.cbytes < per_frame.schunk.cbytes
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_stack_rgb(image):
+    # 4 non-unit dimensions are always a stack
+    im = np.asarray(Image.open(image))[:96, :128]
+    np_array = np.stack([np.roll(im, k, axis=1) for k in range(5)])
+    array = compress(np_array)
+    np.testing.assert_array_equal(array[...], np_array)
+    key = (slice(1, 4), slice(10, 80), slice(5, 100), slice(0, 2))
+    np.testing.assert_array_equal(blosc2_grok.get_slice(array, key), np_array[key])
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_stack_slice(image):
+    np_array = frames(image, 12, np.uint16)
+    array = compress(np_array, blocks=(4, 64, 64), layout="SHWC")
+    np.testing.assert_array_equal(array[...], np_array)
+    key = (slice(3, 10), slice(10, 100), slice(20, 150))
+    np.testing.assert_array_equal(blosc2_grok.get_slice(array, key), np_array[key])
+    np.testing.assert_array_equal(blosc2_grok.get_slice(array, 5), np_array[5])
+    block = blosc2_grok.decode_block(array, 0, 1, window=((5, 60), (7, 50)))
+    np.testing.assert_array_equal(block, np_array[:4, 5:60, 64 + 7:64 + 50])
+    thumb = blosc2_grok.get_slice(array, reduce=1)
+    assert thumb.shape == (12, 64, 96)
@@ -0,0 +1,64 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+from concurrent.futures import ThreadPoolExecutor
+
+
+import blosc2
+
+project_dir = Path(__file__).parent.parent
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('metas', [(20, 80), (10, 50, 100, 200)])
+def test_threads(image, metas):
+    im = Image.open(image)
+    # Convert the image to a numpy array, and stack some copies of it
+    np_array = np.asarray(im)
+    np_array = np.stack([np_array] * 8)
+
+    def compress(meta):
+        # Several blocks per chunk, compressed by several blosc2 threads
+        cparams = {
+            'codec': blosc2.Codec.GROK,
+            'codec_meta': meta,
+            'filters': [],
+            'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+            'nthreads': 4,
+        }
+        return blosc2.asarray(
+            np_array,
+            chunks=(2,) + np_array.shape[1:],
+            blocks=(1,) + np_array.shape[1:],
+            cparams=cparams,
+        )
+
+    # Arrays with different rates are compressed at the same time
+    with ThreadPoolExecutor(max_workers=len(metas)) as executor:
+        arrays = list(executor.map(compress, metas * 2))
+
+    for meta, bl_array in zip(metas * 2, arrays):
+        for i in range(bl_array.schunk.nchunks):
+            nbytes, cbytes, _ = blosc2.get_cbuffer_sizes(bl_array.schunk.get_chunk(i))
+            assert nbytes / cbytes >= meta / 10 - 0.1
+
+    # The defaults are not changed by the lossy compressions above
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    bl_array = blosc2.asarray(
+        np_array[0],
+        chunks=np_array.shape[1:],
+        blocks=np_array.shape[1:],
+        cparams=cparams,
+    )
+    np.testing.assert_array_equal(bl_array[...], np_array[0])
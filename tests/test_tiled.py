@@ -0,0 +1,170 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+
+project_dir = Path(__file__).parent.parent
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png', project_dir / 'examples/MI04_020751.tif'])
+@pytest.mark.parametrize('blocksize', [128, 256])
+@pytest.mark.parametrize('nthreads', [1, 4])
+def test_tiled(image, blocksize, nthreads):
+    im = Image.open(image)
+    # Convert the image to a numpy array
+    np_array = np.asarray(im)
+    blocks = (blocksize, blocksize) + np_array.shape[2:]
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+        'nthreads': nthreads,
+    }
+
+    blosc2_grok.set_params_defaults(tiled_chunk=True)
+    try:
+        bl_array = blosc2.asarray(np_array, chunks=np_array.shape, blocks=blocks, cparams=cparams)
+    finally:
+        blosc2_grok.set_params_defaults()
+
+    assert bl_array.schunk.vlmeta['grok_header'][:2] == b'\xff\x4f'
+    np.testing.assert_array_equal(bl_array[...], np_array)
+    # A single block
+    np.testing.assert_array_equal(bl_array[blocksize:2 * blocksize, :blocksize], np_array[blocksize:2 * blocksize, :blocksize])
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('meta', [2 * 10, 8 * 10])
+def test_tiled_meta(image, meta):
+    im = Image.open(image)
+    # Convert the image to a numpy array
+    np_array = np.asarray(im)
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'codec_meta': meta,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+        'nthreads': 4,
+    }
+
+    blosc2_grok.set_params_defaults(tiled_chunk=True)
+    try:
+        bl_array = blosc2.asarray(np_array, chunks=np_array.shape, blocks=(128, 128, 3), cparams=cparams)
+    finally:
+        blosc2_grok.set_params_defaults()
+
+    assert bl_array.schunk.cratio >= meta / 10 - 0.1
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('nthreads', [1, 4])
+def test_tiled_shared_blocks(image, nthreads):
+    im = Image.open(image)
+    # Convert the image to a numpy array
+    np_array = np.array(im)
+    # Every chunk starts with the same block, so that a chunk buffer reused
+    # for the next chunk cannot be told apart by its first block
+    patch = np_array[:128, :128].copy()
+    for i in range(0, np_array.shape[0], 256):
+        for j in range(0, np_array.shape[1], 256):
+            np_array[i:i + 128, j:j + 128] = patch
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+        'nthreads': nthreads,
+    }
+
+    blosc2_grok.set_params_defaults(tiled_chunk=True)
+    try:
+        bl_array = blosc2.asarray(np_array, chunks=(256, 256, 3), blocks=(128, 128, 3), cparams=cparams)
+    finally:
+        blosc2_grok.set_params_defaults()
+
+    np.testing.assert_array_equal(bl_array[...], np_array)
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('nthreads', [1, 4])
+def test_tiled_in_flight(image, nthreads):
+    im = np.asarray(Image.open(image))
+    # Noise does not fit in its blocks losslessly, so blosc2 may stop coding
+    # the blocks of its chunks half way
+    noise = np.random.default_rng(0).integers(0, 256, size=im.shape, dtype=np.uint8)
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+        'nthreads': nthreads,
+    }
+    kwargs = {'chunks': (128, 256, 3), 'blocks': (64, 64, 3), 'cparams': cparams}
+
+    blosc2_grok.set_params_defaults(tiled_chunk=True)
+    try:
+        blosc2_grok.get_tiled_stats(reset=True)
+        bl_array = blosc2.asarray(im, **kwargs)
+        # More chunks than can be in flight at once, and all of them are dropped
+        assert bl_array.schunk.nchunks > 8
+        stats = blosc2_grok.get_tiled_stats(reset=True)
+        assert stats['chunks'] == bl_array.schunk.nchunks
+        assert stats['unplaced'] == 0 and stats['in_flight'] == 0
+
+        noisy = blosc2.asarray(noise, **kwargs)
+        assert blosc2_grok.get_tiled_stats()['in_flight'] <= 8
+        # The chunks left behind make room for new ones
+        blosc2_grok.get_tiled_stats(reset=True)
+        bl_array2 = blosc2.asarray(im, **kwargs)
+        assert blosc2_grok.get_tiled_stats()['unplaced'] == 0
+    finally:
+        blosc2_grok.set_params_defaults()
+
+    np.testing.assert_array_equal(bl_array[...], im)
+    np.testing.assert_array_equal(bl_array2[...], im)
+    np.testing.assert_array_equal(noisy[...], noise)
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+@pytest.mark.parametrize('dtype, pixel', [(np.uint8, (10, 20, 30)), (np.uint16, (0x0102, 0x0102, 0x0102))])
+@pytest.mark.parametrize('nthreads', [1, 4])
+def test_tiled_const_blocks(image, dtype, pixel, nthreads):
+    np_array = np.asarray(Image.open(image)).astype(dtype)
+    # The first block of every chunk repeats a pixel made of different bytes,
+    # so it is stored as a constant block instead of a tile
+    for i in range(0, np_array.shape[0], 128):
+        for j in range(0, np_array.shape[1], 256):
+            np_array[i:i + 64, j:j + 64] = pixel
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+        'nthreads': nthreads,
+    }
+
+    blosc2_grok.set_params_defaults(tiled_chunk=True)
+    try:
+        blosc2_grok.get_tiled_stats(reset=True)
+        bl_array = blosc2.asarray(np_array, chunks=(128, 256, 3), blocks=(64, 64, 3), cparams=cparams)
+    finally:
+        blosc2_grok.set_params_defaults()
+
+    # Every chunk is dropped once its tiles are out, however many there are
+    assert bl_array.schunk.nchunks > 8
+    stats = blosc2_grok.get_tiled_stats()
+    assert stats['chunks'] == bl_array.schunk.nchunks
+    assert stats['unplaced'] == 0 and stats['in_flight'] == 0
+    np.testing.assert_array_equal(bl_array[...], np_array)
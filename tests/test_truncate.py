@@ -0,0 +1,83 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+
+project_dir = Path(__file__).parent.parent
+
+
+def compress(np_array, **kwargs):
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    # The last layer makes the image lossless
+    blosc2_grok.set_params_defaults(quality_mode='rates', quality_layers=np.array([40, 10, 1], dtype=np.float64),
+                                    **kwargs)
+    try:
+        return blosc2.asarray(
+            np_array,
+            chunks=(256, 256) + np_array.shape[2:],
+            blocks=(128, 128) + np_array.shape[2:],
+            cparams=cparams,
+        )
+    finally:
+        blosc2_grok.set_params_defaults()
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png', project_dir / 'examples/MI04_020751.tif'])
+@pytest.mark.parametrize('mode', ['default', 'headerless', 'tiled_chunk'])
+@pytest.mark.parametrize('layers', [1, 2])
+def test_truncate(image, mode, layers):
+    im = Image.open(image)
+    # Convert the image to a numpy array
+    np_array = np.asarray(im)
+    kwargs = {} if mode == 'default' else {mode: True}
+    bl_array = compress(np_array, writePLT=True, **kwargs)
+    expected = blosc2_grok.get_slice(bl_array, layers=layers)
+    cbytes = bl_array.schunk.cbytes
+
+    blosc2_grok.truncate_layers(bl_array, layers=layers)
+    assert bl_array.schunk.cbytes < cbytes
+    # Same as decoding the first layers of the original blocks
+    np.testing.assert_array_equal(bl_array[...], expected)
+
+    # It can be truncated again
+    blosc2_grok.truncate_layers(bl_array, layers=1)
+    np.testing.assert_array_equal(bl_array[...], blosc2_grok.get_slice(bl_array, layers=1))
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_truncate_rate(image):
+    im = Image.open(image)
+    np_array = np.asarray(im)
+    bl_array = compress(np_array, writePLT=True)
+    cratio = bl_array.schunk.cratio
+
+    blosc2_grok.truncate_layers(bl_array, rate=10)
+    assert bl_array.schunk.cratio > cratio
+    assert bl_array.schunk.cratio >= 10 - 0.5
+    _ = bl_array[...]
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_truncate_no_plt(image):
+    im = Image.open(image)
+    np_array = np.asarray(im)
+    bl_array = compress(np_array)
+
+    with pytest.raises(RuntimeError):
+        blosc2_grok.truncate_layers(bl_array, layers=1)
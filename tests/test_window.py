@@ -0,0 +1,79 @@
+##############################################################################
+# blosc2_grok: Grok (JPEG2000 codec) plugin for Blosc2
+#
+# Copyright (c) 2023  The Blosc Development Team <blosc@blosc.org>
+# https://blosc.org
+# License: GNU Affero General Public License v3.0 (see LICENSE.txt)
+##############################################################################
+
+import numpy as np
+import pytest
+from PIL import Image
+from pathlib import Path
+
+
+import blosc2
+import blosc2_grok
+
+project_dir = Path(__file__).parent.parent
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png', project_dir / 'examples/MI04_020751.tif'])
+@pytest.mark.parametrize('mode', ['default', 'headerless', 'tiled_chunk'])
+@pytest.mark.parametrize('key', [
+    (slice(100, 300), slice(50, 400)),
+    (slice(5, 9), slice(130, 131)),
+    (17, slice(None)),
+    (slice(128, 256), slice(0, 128)),
+])
+def test_window(image, mode, key):
+    im = Image.open(image)
+    # Convert the image to a numpy array
+    np_array = np.asarray(im)
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    kwargs = {} if mode == 'default' else {mode: True}
+    blosc2_grok.set_params_defaults(**kwargs)
+    try:
+        bl_array = blosc2.asarray(
+            np_array,
+            chunks=(256, 256) + np_array.shape[2:],
+            blocks=(128, 128) + np_array.shape[2:],
+            cparams=cparams,
+        )
+    finally:
+        blosc2_grok.set_params_defaults()
+
+    # Lossless, so windows are exact
+    np.testing.assert_array_equal(blosc2_grok.get_slice(bl_array, key), np_array[key])
+    if np_array.ndim == 3:
+        # Only some components: decoded aside and copied
+        np.testing.assert_array_equal(blosc2_grok.get_slice(bl_array, key + (1,)), np_array[key + (1,)])
+
+    # A window of a reduced slice is the same part of the reduced image
+    thumb = blosc2_grok.get_slice(bl_array, reduce=1)
+    rkey = tuple(slice(-(-k.start // 2), -(-k.stop // 2)) if isinstance(k, slice) and k.start is not None
+                 else (k // 2 if isinstance(k, int) else k) for k in key)
+    if not any(isinstance(k, int) and k % 2 for k in key):
+        np.testing.assert_array_equal(blosc2_grok.get_slice(bl_array, key, reduce=1), thumb[rkey])
+
+
+@pytest.mark.parametrize('image', [project_dir / 'examples/kodim23.png'])
+def test_decode_block_window(image):
+    im = Image.open(image)
+    np_array = np.asarray(im)
+
+    cparams = {
+        'codec': blosc2.Codec.GROK,
+        'filters': [],
+        'splitmode': blosc2.SplitMode.NEVER_SPLIT,
+    }
+    bl_array = blosc2.asarray(np_array, chunks=(256, 256, 3), blocks=(128, 128, 3), cparams=cparams)
+
+    block = blosc2_grok.decode_block(bl_array, 0, 1, window=((10, 20), (30, 100)))
+    np.testing.assert_array_equal(block, np_array[10:20, 128 + 30:128 + 100])
+
+    with pytest.raises(RuntimeError):
+        blosc2_grok.decode_block(bl_array, 0, 1, window=((0, 10), (0, 200)))